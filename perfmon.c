@@ -0,0 +1,234 @@
+/* perfmon.c
+ *
+ * performance monitor module
+ * time-stamps stage entry and exit using the Timer1 count (CPU cycles into
+ * the current scan line) and the scan line counter, and keeps min/max/average
+ * statistics per stage in a fixed table.
+ * optionally draws frame budget bars into spare rows of the video buffer
+ * so that frame-budget headroom can be checked without a scope.
+ *
+ */
+
+#include    <stdint.h>
+#include    <stdlib.h>
+
+#include    <avr/io.h>
+#include    <util/atomic.h>
+
+#include    "videoutil.h"
+#include    "perfmon.h"
+
+#if defined(PERFHUD) && !defined(PERFMON)
+#error "PERFHUD requires PERFMON"
+#endif
+
+/* ----------------------------------------------------------------------------
+ * global variables
+ */
+uint16_t    cyclesPerLine   = 1;            // Timer1 counts per scan line (ICR1 + 1)
+uint16_t    linesPerField   = 1;            // scan lines in a field
+uint32_t    budgetCycles    = 1;            // CPU cycles available to game() per field, over 64K with fast clocks
+
+perfstage_t perfTable[PERFSTAGES];          // stage statistics table
+uint16_t    startLine[PERFSTAGES];          // stage entry time stamps
+uint16_t    startCount[PERFSTAGES];
+
+extern uint16_t getscanline(void);
+
+/* ----------------------------------------------------------------------------
+ * function definitions
+ */
+static void perfstamp(uint16_t*, uint16_t*);
+static void perfbar(video_t*, uint16_t, uint16_t, uint32_t);
+
+/* ----------------------------------------------------------------------------
+ * perfinit()
+ *
+ *  initialize the performance monitor with the Timer1 count per scan line,
+ *  the number of scan lines in a field and the cycles budget of game()
+ *
+ */
+void perfinit(uint16_t lineCycles, uint16_t fieldLines, uint32_t gameBudget)
+{
+    cyclesPerLine = lineCycles;
+    linesPerField = fieldLines;
+    budgetCycles  = gameBudget;
+
+    perfreset();
+}
+
+/* ----------------------------------------------------------------------------
+ * perfreset()
+ *
+ *  clear all stage statistics
+ *
+ */
+void perfreset(void)
+{
+    uint8_t     i;
+
+    for (i = 0; i < PERFSTAGES; i++)
+    {
+        perfTable[i].min    = 0xffff;
+        perfTable[i].max    = 0;
+        perfTable[i].last   = 0;
+        perfTable[i].avgAcc = 0;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * perfbegin()
+ *
+ *  time-stamp stage entry
+ *
+ */
+void perfbegin(uint8_t stage)
+{
+    if ( stage >= PERFSTAGES ) return;
+
+    perfstamp(&startLine[stage], &startCount[stage]);
+}
+
+/* ----------------------------------------------------------------------------
+ * perfend()
+ *
+ *  time-stamp stage exit, calculate elapsed CPU cycles since stage entry
+ *  and update the stage's statistics
+ *
+ */
+void perfend(uint8_t stage)
+{
+    uint16_t    line;
+    uint16_t    count;
+
+    if ( stage >= PERFSTAGES ) return;
+
+    perfstamp(&line, &count);
+
+    // elapsed lines, accounting for wrap at end of field
+    if ( line < startLine[stage] )
+        line += linesPerField;
+
+    perfsample(stage, ((line - startLine[stage]) * cyclesPerLine) + count - startCount[stage]);
+}
+
+/* ----------------------------------------------------------------------------
+ * perfsample()
+ *
+ *  update the statistics of a stage with a cycle count measured by the caller.
+ *  used for code that cannot afford perfbegin()/perfend(), such as the renderer()
+ *  that only latches a Timer1 count, the statistics are then updated from game()
+ *
+ */
+void perfsample(uint8_t stage, uint16_t cycles)
+{
+    perfstage_t *p;
+
+    if ( stage >= PERFSTAGES ) return;
+
+    p = &perfTable[stage];
+    p->last = cycles;
+    if ( cycles < p->min )
+        p->min = cycles;
+    if ( cycles > p->max )
+        p->max = cycles;
+    if ( p->avgAcc == 0 )
+        p->avgAcc = (uint32_t) cycles << PERFAVGSHIFT;  // seed average with first sample
+    else
+        p->avgAcc += cycles - (p->avgAcc >> PERFAVGSHIFT);
+}
+
+/* ----------------------------------------------------------------------------
+ * perfavg()
+ *
+ *  get rolling average of a stage in CPU cycles
+ *
+ */
+uint16_t perfavg(uint8_t stage)
+{
+    if ( stage >= PERFSTAGES ) return 0;
+
+    return (uint16_t) (perfTable[stage].avgAcc >> PERFAVGSHIFT);
+}
+
+/* ----------------------------------------------------------------------------
+ * perfget()
+ *
+ *  get statistics of a stage
+ *
+ */
+const perfstage_t* perfget(uint8_t stage)
+{
+    if ( stage >= PERFSTAGES ) return 0;
+
+    return &perfTable[stage];
+}
+
+/* ----------------------------------------------------------------------------
+ * perfhud()
+ *
+ *  draw performance HUD into video buffer 'v' starting at 'row'
+ *  the HUD uses PERFHUDROWS rows and the full width of the video buffer,
+ *  so it fits in the spare rows below the game board:
+ *
+ *    [bar: worst case game() cycles, full width is the game() budget]
+ *    [bar: worst case renderer() end, full width is the scan line]
+ *
+ *  the cycle counts behind the bars are read with perfget() and perfavg().
+ *  redraw is done every PERFHUDRATE calls to keep HUD drawing cost low.
+ *  call after PERF_END(PERF_GAME) so the HUD is not included in the game() measurement.
+ *
+ */
+void perfhud(video_t* v, uint16_t row)
+{
+    static uint8_t  frameCount = 0;
+
+    frameCount++;
+    if ( frameCount < PERFHUDRATE )
+        return;
+    frameCount = 0;
+
+    clearbox(v, 0, row, getXres(v), (row + PERFHUDROWS - 1));
+
+    perfbar(v, row, perfTable[PERF_GAME].max, budgetCycles);
+    perfbar(v, (row + 1), perfTable[PERF_RENDER].max, cyclesPerLine);
+}
+
+/* ----------------------------------------------------------------------------
+ * perfstamp()
+ *
+ *  read scan line and Timer1 count as one time stamp
+ *  interrupts are disabled while reading because the phase ISR writes OCR1A,
+ *  which shares the 16-bit TEMP register with the TCNT1 read, and updates the
+ *  phase registers that the scan line is calculated from.
+ *  if the timer overflowed but the ISR did not run yet, the scan line is
+ *  advanced here to match the (small) count value.
+ *
+ */
+static void perfstamp(uint16_t* line, uint16_t* count)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *count = TCNT1;
+        *line  = getscanline();
+        if ( bit_is_set(TIFR1, TOV1) && *count < (cyclesPerLine / 2) )
+            *line += 1;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * perfbar()
+ *
+ *  draw a bar on row 'row' with the length of 'cycles' as a portion of 'budget',
+ *  full width of the video buffer for the complete budget
+ *
+ */
+static void perfbar(video_t* v, uint16_t row, uint16_t cycles, uint32_t budget)
+{
+    uint16_t    barLength;
+
+    barLength = (uint16_t) (((uint32_t) cycles * getXres(v)) / budget);
+    if ( barLength >= getXres(v) )
+        barLength = getXres(v) - 1;
+    line(v, 0, row, barLength, row);
+}
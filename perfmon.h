@@ -0,0 +1,62 @@
+/* perfmon.h
+ *
+ * header file for the performance monitor that time-stamps game and
+ * render stages with Timer1 cycle counts and the scan line number
+ *
+ * build with -DPERFMON to enable stage time-stamping and
+ * with -DPERFHUD (in addition to PERFMON) to draw the on-screen HUD
+ *
+ */
+
+#ifndef __PERFMON_H__
+#define __PERFMON_H__
+
+/* ----------------------------------------------------------------------------
+ *  definitions
+ */
+#define     PERF_ADC        0               // paddle ADC reads
+#define     PERF_PADDLE     1               // paddle movement
+#define     PERF_BALL       2               // ball movement and collision
+#define     PERF_SCORE      3               // score update
+#define     PERF_SOUND      4               // sound state machine
+#define     PERF_RENDER     5               // renderer() end, Timer1 count on the last rendered line
+#define     PERF_GAME       6               // complete game() routine
+#define     PERFSTAGES      7               // number of stages in the stage table
+
+#define     PERFAVGSHIFT    4               // rolling average weight: new sample is 1/16
+
+#define     PERFHUDRATE     30              // redraw HUD every 30 frames (0.5 sec)
+#define     PERFHUDROWS     2               // frame buffer rows used by the HUD
+
+#ifdef PERFMON
+#define     PERF_BEGIN(s)   perfbegin(s)
+#define     PERF_END(s)     perfend(s)
+#else
+#define     PERF_BEGIN(s)
+#define     PERF_END(s)
+#endif
+
+/* ----------------------------------------------------------------------------
+ *  types
+ */
+typedef struct
+{
+    uint16_t    min;                        // shortest stage time in CPU cycles
+    uint16_t    max;                        // longest stage time in CPU cycles
+    uint16_t    last;                       // last measured stage time in CPU cycles
+    uint32_t    avgAcc;                     // rolling average accumulator, average = avgAcc >> PERFAVGSHIFT
+} perfstage_t;
+
+/* ----------------------------------------------------------------------------
+ *  function prototypes
+ */
+void        perfinit(uint16_t, uint16_t, uint32_t); // initialize with cycles per line, lines per field, game budget cycles
+void        perfreset(void);                        // clear stage statistics
+void        perfbegin(uint8_t);                     // time-stamp stage entry
+void        perfend(uint8_t);                       // time-stamp stage exit and update stage statistics
+void        perfsample(uint8_t, uint16_t);          // update stage statistics with a cycle count measured by the caller
+uint16_t    perfavg(uint8_t);                       // get rolling average of a stage in CPU cycles
+const perfstage_t* perfget(uint8_t);                // get statistics of a stage
+void        perfhud(video_t*, uint16_t);            // draw budget bars starting at frame buffer row
+
+#endif /* __PERFMON_H__ */
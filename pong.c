@@ -2,11 +2,13 @@
  *
  * video generator and "pong" game for AVR ATmega328p
  * running at internal 8Mhz clock on NTSC TV input
+ * other clocks and PAL are selected with the build options in videotiming.h
  *
  */
 
 #include    <stdint.h>
 #include    <stdlib.h>
+#include    <stddef.h>
 
 #include    <avr/pgmspace.h>
 #include    <avr/io.h>
@@ -14,66 +16,188 @@
 #include    <avr/sleep.h>
 #include    <avr/wdt.h>
 
+#include    "videotiming.h"
 #include    "videoutil.h"
 #include    "ponggame.h"
+#include    "perfmon.h"
 
 /* ----------------------------------------------------------------------------
  * global definitions
  */
-#define     SYSTEMCLK       8000000         // system clock frequency in Hz
-
-// counter constants for timing
-// all counts are reduced to compensate for timing on program
-#define     LINERATE        495             // horizontal line rate 63.5uSec @ 8MKz clock (with TIMER1 Fclk/1)
-#define     LINERATEHALF    (LINERATE/2)    // half the horizontal sync rate 31.75uSec @ 8MKz clock (with TIMER0 Fclk/1)
-#define     HSYNC           35              // horizontal sync pulse width 4.7uSec @ 8MKz clock (with TIMER0 Fclk/1)
-#define     VSYNC           435             // vsync pulse width
-#define     BACKPORCH       SYNCWIDTH       // back-porch time width 4.7uSec @ 8MKz clock (with TIMER0 Fclk/1)
-
-// non-interlace video 48x80 pixels
-#define     FIRSTLINE       0               // first visible scan line index
-#define     POSTRENDER      240             // blank lines after render
-#define     VSYNCLINE       245             // line to produce v-sync pulse
-#define     PRERENDER       248             // blank lines before restarting render
-#define     LINESINFIELD    262             // total lines in field
-#define     RENDERREP       3               // number of time to repeat a line rendering (save RAM lower resolution)
-#define     PIXELBYTES      11              // bytes in scan line, pixel-resolution = PIXELBYTES x 8
-
-#define     VISIBLELINES    POSTRENDER      // 240 visible lines
-#define     VIDEORAM        ((VISIBLELINES * PIXELBYTES) / RENDERREP) // video ram size in bytes
+// timing counts, scan line structure and pixel rate are in videotiming.h
+
+// non-interlace video PIXELSX x PIXELSY pixels
+#define     LINESPERROW     3               // scan lines rendered per video RAM row (save RAM lower resolution)
 
 #define     PIXELSX         (PIXELBYTES * 8)
-#define     PIXELSY         (VISIBLELINES / RENDERREP)
+#define     PIXELSY         (BOTTOM + 3)    // game board rows, the performance HUD uses the 2 rows below the bottom wall
+#define     VIDEORAM        (PIXELSY * PIXELBYTES)      // video ram size in bytes
+
+// active window: only the scan lines that show video RAM rows are rendered,
+// the window is centered in the visible lines and the blank lines above and below it
+// are handed to game() together with the v-sync blanking lines
+#define     ACTIVELINES     (PIXELSY * LINESPERROW)                 // rendered scan lines
+#define     FIRSTLINE       ((VISIBLELINES - ACTIVELINES) / 2)      // first rendered scan line index
+#define     POSTRENDER      (FIRSTLINE + ACTIVELINES)               // first blank line after render
+#define     RENDERARM       (FIRSTLINE - 1)                         // blank line that enters the render phase
+#define     GAMELINES       (LINESINFIELD - POSTRENDER + RENDERARM) // scan lines available to game() per field
+
+#if ( ACTIVELINES > VISIBLELINES )
+#error "video RAM rows do not fit in visible scan lines"
+#endif
+
+#if ( ACTIVELINES > SHOWNLINES )
+#error "active window is taller than the scan lines a TV shows"
+#endif
+
+#if defined(PERFHUD) && ( (BOTTOM + 1 + PERFHUDROWS) > PIXELSY )
+#error "performance HUD does not fit below the game board"
+#endif
+
+#if ( FIRSTLINE < 1 )
+#error "no blank line before the active window to enter the render phase"
+#endif
+
+#define     ROWSETUPCYCLES  (PIXELSY * 80)  // setuprows() estimate, about 50 cycles per row with margin
+
+#if ( (GAMELINES * LINECYCLES) < (GAMECYCLES + ROWSETUPCYCLES) )
+#error "game() and row set-up do not fit in the blank lines"
+#endif
+
+#if ( (VIDEORAM + (PIXELSY * 6)) > 1792 )
+#error "video RAM and row table leave less than 256 bytes of RAM for globals and stack"
+#endif
+
+// the game() budget is passed to perfinit() as 32 bits, stage cycle counts are 16 bits
+#if defined(PERFMON) && ( GAMECYCLES > 0xffff )
+#error "game() cycles do not fit the performance monitor stage counters"
+#endif
+
+#if ( PIXELBYTES < 3 )
+#error "renderer() needs a first, middle and last pixel byte"
+#endif
+
+// field phases for the scan line ISR action table
+#define     PHASERENDER     0               // RENDERARM to POSTRENDER-1, render video RAM rows from FIRSTLINE
+#define     PHASEGAME       1               // POSTRENDER to VSYNCLINE-1, blank lines, game() hooked
+#define     PHASEVSYNC      2               // VSYNCLINE to PRERENDER-1, v-sync pulses
+#define     PHASEBLANK      3               // PRERENDER to RENDERARM-1 of next field, blank lines
+#define     PHASES          4
+
+#define     PHASERESET      0x01            // phase flag: reset render pointers
+
+#if ( (ACTIVELINES + 1) > 255 ) || ( (VSYNCLINE - POSTRENDER) > 255 ) || ( (LINESINFIELD - PRERENDER + RENDERARM) > 255 )
+#error "field phase longer than 255 lines"
+#endif
+
+// ADC clock prescaler, keep the ADC clock at or below 4MHz (8-bit conversions)
+#if ( SYSTEMCLK > 8000000UL )
+#define     ADCPRESCALE     0x02            // Fclk/4
+#else
+#define     ADCPRESCALE     0x00            // Fclk/2
+#endif
 
 /* ----------------------------------------------------------------------------
- * global variables
+ * types
  */
-volatile uint16_t   scanLine;               // scan line counter
-
-void        (*activeFunction)(void);        // pointer to active function: render(), game(), or idle()
-uint16_t    videoRamIndex;                  // for holding a pre-calculated index
-uint8_t     lineRepeat;
-uint8_t     videoRAM[VIDEORAM];             // video RAM buffer
+typedef struct
+{
+    uint16_t    firstLine;                  // first scan line of the phase
+    uint8_t     lines;                      // scan lines in the phase
+    uint8_t     flags;                      // phase flags
+    uint16_t    syncWidth;                  // OCR1A value for the phase's sync pulses
+    void        (*function)(void);          // function to hook at start of phase, 0 to leave as is
+} phase_t;
+
+typedef struct
+{
+    uint8_t     ruleTop;                    // video RAM row of top horizontal rule
+    uint8_t     ruleBottom;                 // video RAM row of bottom horizontal rule
+    uint8_t     netByte;                    // byte column of the dashed vertical net
+    uint8_t     netMask;                    // pixel mask of the net in its byte, 0 for no net
+    uint8_t     netPeriod;                  // net dash period in rows, power of 2
+    uint8_t     netLength;                  // net dash length in rows
+    uint8_t     borderLeft;                 // left border pixel mask in first byte between the rules, 0 for none
+    uint8_t     borderRight;                // right border pixel mask in last byte between the rules, 0 for none
+} background_t;
+
+typedef struct
+{
+    uint8_t     *pixels;                    // pixel bytes of the row, first field, renderer() loads it from offset 0
+    uint8_t     first;                      // background of the first pixel byte
+    uint8_t     middle;                     // background of the pixel bytes between first and last
+    uint8_t     net;                        // background of the net byte
+    uint8_t     last;                       // background of the last pixel byte
+} rowsetup_t;
 
 /* ----------------------------------------------------------------------------
  * function definitions
  */
 void ioinit(void);
-void renderer(void);
-void game(void);
+void setuprows(void);
+void setbackground(const background_t*);
+uint8_t bgbyte(uint16_t, uint8_t);
+void renderer(void) __attribute__ ((naked));
+void renderarm(void);
+void playgame(void);
 void idle(void);
+uint16_t getscanline(void);
+
+/* ----------------------------------------------------------------------------
+ * global variables
+ *
+ * the scan line ISR keeps its state in general purpose IO registers
+ * so the per line path needs no RAM access and only one work register:
+ *  GPIOR0  scan lines left in current field phase
+ *  GPIOR1  current field phase index
+ */
+void        (*activeFunction)(void);        // pointer to active function: render(), game(), or idle()
+rowsetup_t  *rowSetup;                      // row table entry of the row being rendered
+uint8_t     lineRepeat;
+uint8_t     videoRAM[VIDEORAM];             // video RAM buffer
+game_t      pong;                           // game state
+
+// row table, built by setuprows() in the v-blank and read by renderer() one entry per row
+// the background layer is merged into the pixel bytes by renderer()
+rowsetup_t  rowTable[PIXELSY];              // pixel address and background bytes of every video RAM row
+uint8_t     netByte;                        // byte column with the 'net' background, 0xff for none
+const background_t *bgLayer;                // background descriptor in flash, 0 for no background
+
+#ifdef PERFMON
+uint16_t    renderEnd;                      // Timer1 count at the end of renderer(), latched on every rendered line
+#endif
+
+video_t     screen;                         // drawing state of video RAM
+region_t    region;                         // double buffered region, see regioninit() in videoutil.c
+
+// static game board, rendered from this descriptor and not stored in video RAM
+const background_t board PROGMEM =
+{
+    TOP, BOTTOM,                            // top and bottom walls
+    ((PIXELSX/2) / 8), (0x80 >> ((PIXELSX/2) % 8)), 4, 2,   // dashed line down the middle, 2 of every 4 rows
+    0, 0                                    // no side borders
+};
+
+// field phase action table, in field order
+const phase_t phaseTable[PHASES] PROGMEM =
+{
+    { RENDERARM,  (ACTIVELINES + 1),                        0,          HSYNC, &renderarm },
+    { POSTRENDER, (VSYNCLINE - POSTRENDER),                 0,          HSYNC, &playgame  },
+    { VSYNCLINE,  (PRERENDER - VSYNCLINE),                  PHASERESET, VSYNC, 0          },
+    { PRERENDER,  (LINESINFIELD - PRERENDER + RENDERARM),   0,          HSYNC, 0          }
+};
 
 /* ----------------------------------------------------------------------------
  * ioinit()
  *
  *  initialize IO interfaces
- *  timer and data rates calculated based on 4MHz internal clock
+ *  timer and data rates are calculated in videotiming.h based on SYSTEMCLK
  *
  */
 void ioinit(void)
 {
-    // reconfigure system clock scaler to 10MHz and/or source
-    CLKPR = 0x80;           // change clock scaler to divide by 1 (sec 8.12.2 p.37)
+    // reconfigure system clock scaler, the clock source (internal RC or crystal) is set by fuses
+    CLKPR = 0x80;           // change clock scaler to divide by 1 so CPU runs at SYSTEMCLK (sec 8.12.2 p.37)
     CLKPR = 0x00;
 
     // Timer0 for audio beeps
@@ -90,12 +214,12 @@ void ioinit(void)
     TCNT1  = 0;             // initialize counter to 0
     OCR1A  = HSYNC;         // produce a sync pulse
     OCR1B  = 0;             // not used
-    ICR1   = LINERATE;      // PWM TOP value for 63.5uSec lane rate
+    ICR1   = LINERATE;      // PWM TOP value for 63.5uSec (NTSC) or 64uSec (PAL) line rate
     TIMSK1 = 0x01;          // interrupt on timer overflow (every scan line)
 
     // initialize ADC converter input ADC0
     ADMUX  = 0x60;  // external AVcc reference, left adjusted result, ADC0 source
-    ADCSRA = 0x10;  // don't enable ADC, no auto-triggered conversion, no interrupts, ADC clock Fclk/2, force clear ADIF bit
+    ADCSRA = 0x10 | ADCPRESCALE;    // don't enable ADC, no auto-triggered conversion, no interrupts, ADC clock Fclk/2 or Fclk/4, force clear ADIF bit
     ADCSRB = 0x00;  // free-running trigger source
     DIDR0  = 0x03;  // disable digital input on ADC0 and ADC1 pins
 
@@ -104,7 +228,7 @@ void ioinit(void)
     //         or see description of the UDRIE bit for interrupt on 'Data Register Empty'
     UCSR0B = 0x00;          // don't enable transmitter yet, idle is 'hi' and we need a 'lo', set bit.5 UDRIE for interrupt setup
     UCSR0C = 0xC0;          // SPI mode, Tx MSB first
-    UBRR0L = 1;             // to get 2Mbps (see Table 20-1 page 205)
+    UBRR0L = PIXELUBRR;     // to get PIXELBAUD, 2Mbps by default (see Table 20-1 page 205)
     UBRR0H = 0;
 
     // initialize general IO pins for output
@@ -122,46 +246,197 @@ void ioinit(void)
  * logic follows this article: http://sagargv.blogspot.in/2011/06/ntsc-demystified-cheats-part-6.html
  *
  * picture scan lines according to: http://wiki.nesdev.com/w/index.php/NTSC_video
- * 0    - 239   (240)   active picture video data
+ * 0    - 239   (240)   picture area, rendered only between FIRSTLINE and POSTRENDER-1
  * 240  - 244   (  5)   blank video
  * 245  - 247   (  3)   v-sync
  * 248  - 261   ( 14)   blank video
  *            --------
  *               262 lines
  *
+ * game() is hooked through playgame() from POSTRENDER and has all lines until RENDERARM of the next field
+ *
+ * the field is split into the four phases of phaseTable[].
+ * on every line the ISR only decrements the phase line counter in GPIOR0,
+ * this path is 29 cycles including interrupt response from sleep and the vector jump,
+ * the old switch() ISR with its C prologue took about 90 cycles on every line.
+ * when the counter reaches zero it jumps to the phase ISR that loads the next
+ * phase's actions from the table, this happens only 4 times per field.
+ * the phase ISR with its C prologue and flash reads is too long for a rendered line,
+ * so the render phase is entered on the blank line RENDERARM before the active window,
+ * and all rendered lines, including the first, take the 29 cycle path.
+ *
  */
-ISR(TIMER1_OVF_vect)
+ISR(TIMER1_OVF_vect, ISR_NAKED)
 {
-    switch ( scanLine )
+    __asm__ __volatile__ (
+        "push   r24                 \n\t"
+        "in     r24, __SREG__       \n\t"
+        "push   r24                 \n\t"
+        "in     r24, %[count]       \n\t"     // decrement lines left in phase
+        "dec    r24                 \n\t"
+        "out    %[count], r24       \n\t"
+        "breq   1f                  \n\t"
+        "pop    r24                 \n\t"     // phase continues, return
+        "out    __SREG__, r24       \n\t"
+        "pop    r24                 \n\t"
+        "reti                       \n\t"
+        "1:                         \n\t"
+        "pop    r24                 \n\t"     // end of phase, restore state and
+        "out    __SREG__, r24       \n\t"     // continue in phase ISR as if it was the vector
+        "pop    r24                 \n\t"
+        "jmp    __vector_scanphase  \n\t"
+        :: [count] "I" (_SFR_IO_ADDR(GPIOR0))
+    );
+}
+
+/* ----------------------------------------------------------------------------
+ * phase ISR
+ *
+ *  entered from the scan line ISR on the first line of a new field phase
+ *  advance to the next phase and apply its actions from phaseTable[]
+ *
+ */
+ISR(__vector_scanphase)
+{
+    const phase_t   *phase;
+    void            (*function)(void);
+    uint8_t         phaseIndex;
+
+    phaseIndex = GPIOR1 + 1;
+    if ( phaseIndex == PHASES )
+        phaseIndex = 0;
+    GPIOR1 = phaseIndex;
+
+    phase  = &phaseTable[phaseIndex];
+    GPIOR0 = pgm_read_byte(&phase->lines);
+    OCR1A  = pgm_read_word(&phase->syncWidth);
+
+    function = (void (*)(void)) pgm_read_word(&phase->function);
+    if ( function )
+        activeFunction = function;
+
+    if ( pgm_read_byte(&phase->flags) & PHASERESET )
     {
-    // start rendering
-    case FIRSTLINE:
-        OCR1A = HSYNC;
-        activeFunction = &renderer;
-        break;
-
-    // switch to blank line at end of visible area
-    case POSTRENDER:
-        activeFunction = &game;
-        break;
-
-    // change PWM timing to issue a v-sync wide pulse
-    case VSYNCLINE:
-        OCR1A = VSYNC;
         lineRepeat = 0;
-        videoRamIndex = 0;
-        break;
+        rowSetup = rowTable;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * setuprows()
+ *
+ *  build the row table for renderer(): the pixel byte address of every video RAM row,
+ *  rows in the double buffered region are read from the region's front buffer,
+ *  and the row's background bytes from the current background descriptor,
+ *  or none if there is no descriptor.
+ *  a net in the first or last byte is merged into that byte's background.
+ *  called from playgame() in the v-blank, so renderer() only loads one entry per row
+ *
+ */
+void setuprows(void)
+{
+    const background_t  *bg;
+    rowsetup_t          *setup;
+    uint8_t             top, bottom, netColumn, netMask, netPeriod, netLength, left, right;
+    uint8_t             row, rule, net, inside;
+
+    top = bottom = netColumn = 0xff;        // no rule rows and no net
+    netMask = netLength = left = right = 0;
+    netPeriod = 1;
 
-    // change PWM timing back to h-sync narrow pulse
-    case PRERENDER:
-        OCR1A = HSYNC;
-        break;
+    bg = bgLayer;
+    if ( bg )
+    {
+        top       = pgm_read_byte(&bg->ruleTop);
+        bottom    = pgm_read_byte(&bg->ruleBottom);
+        netColumn = pgm_read_byte(&bg->netByte);
+        netMask   = pgm_read_byte(&bg->netMask);
+        netPeriod = pgm_read_byte(&bg->netPeriod);
+        netLength = pgm_read_byte(&bg->netLength);
+        left      = pgm_read_byte(&bg->borderLeft);
+        right     = pgm_read_byte(&bg->borderRight);
     }
 
-    // increment scan line and wrap to 1 if needed
-    scanLine++;
-    if ( scanLine == LINESINFIELD )
-        scanLine = 0;
+    for ( row = 0, setup = rowTable; row < PIXELSY; row++, setup++ )
+    {
+        if ( (uint8_t) (row - region.top) < region.rows )
+            setup->pixels = region.front + ((row - region.top) * PIXELBYTES);
+        else
+            setup->pixels = videoRAM + (row * PIXELBYTES);
+
+        inside = ( row > top && row < bottom );
+        rule   = ( row == top || row == bottom ) ? 0xff : 0;
+        net    = ( inside && ((row - top) & (netPeriod - 1)) < netLength ) ? netMask : 0;
+
+        setup->first  = rule | (inside ? left : 0)  | ((netColumn == 0) ? net : 0);
+        setup->middle = rule;
+        setup->net    = rule | net;
+        setup->last   = rule | (inside ? right : 0) | ((netColumn == (PIXELBYTES - 1)) ? net : 0);
+    }
+
+    netByte = ( netColumn > 0 && netColumn < (PIXELBYTES - 1) ) ? netColumn : 0xff;
+}
+
+/* ----------------------------------------------------------------------------
+ * setbackground()
+ *
+ *  select the background layer descriptor in flash, or 0 for no background
+ *  (for example while a full screen image is shown).
+ *  call from game(), the row table is rebuilt after game() returns
+ *  so the new background is shown from the top of the next field
+ *
+ */
+void setbackground(const background_t* bg)
+{
+    bgLayer = bg;
+}
+
+/* ----------------------------------------------------------------------------
+ * bgbyte()
+ *
+ *  return the background byte of video RAM row 'row' at byte column 'column'
+ *  as renderer() shows it in this field, from the row table.
+ *  set as the background layer of the screen with videobackground() so that
+ *  ppeek() and blit() collision tests see the walls and the net
+ *
+ */
+uint8_t bgbyte(uint16_t row, uint8_t column)
+{
+    const rowsetup_t    *setup;
+
+    if ( row >= PIXELSY )
+        return 0;
+
+    setup = &rowTable[row];
+    if ( column == 0 )
+        return setup->first;
+    if ( column == (PIXELBYTES - 1) )
+        return setup->last;
+    if ( column == netByte )
+        return setup->net;
+
+    return setup->middle;
+}
+
+/* ----------------------------------------------------------------------------
+ * getscanline()
+ *
+ *  return the current scan line number, 0 to LINESINFIELD-1,
+ *  calculated from the ISR phase state.
+ *  call with interrupts disabled so GPIOR0 and GPIOR1 are consistent
+ *
+ */
+uint16_t getscanline(void)
+{
+    const phase_t   *phase;
+    uint16_t        line;
+
+    phase = &phaseTable[GPIOR1];
+    line  = pgm_read_word(&phase->firstLine) + pgm_read_byte(&phase->lines) - GPIOR0;
+    if ( line >= LINESINFIELD )
+        line -= LINESINFIELD;
+
+    return line;
 }
 
 /* ----------------------------------------------------------------------------
@@ -173,50 +448,184 @@ ISR(TIMER1_OVF_vect)
  *  this is because we have an inverter (74LS14) on the pixel output.
  *  the inverter was added to eliminate the '1' pulse that the UART sends
  *  when it is enabled.
+ *  the static board background (rules, net, borders) is OR-ed into the pixel
+ *  bytes on the way out, while the previous byte is shifting, so video RAM
+ *  holds only the moving objects and scores.
+ *
+ *  the row's pixel address and background bytes come from one row table entry
+ *  built by setuprows() in the v-blank. the function is in assembly so its
+ *  cycles are counted from the instructions (see videotiming.h):
+ *  22 cycles of set-up before the PIXELSTART poll, 18 cycles per middle byte,
+ *  the row advance runs while the last data byte shifts out, and the tail
+ *  after the last pixel is only the UART shut-down and return (RENDERTAIL).
+ *  only call-used registers are touched, r1 is the zero register.
  *
  */
+#ifdef PERFMON
+#define     RENDERLATCH     "lds    r24, %[tcntl]       \n\t"     /* Timer1 count at the end of renderer(), low byte first */ \
+                            "lds    r25, %[tcnth]       \n\t" \
+                            "sts    renderEnd, r24      \n\t" \
+                            "sts    renderEnd+1, r25    \n\t"
+#else
+#define     RENDERLATCH     ""
+#endif
+
 void renderer(void)
 {
-    uint8_t     byteCount;
-
-    // send first data byte to USART to set up transmitter buffer
-    UDR0 = ~(videoRAM[videoRamIndex]); // invert and send first pixel byte (pixel output has n inverter on it
-    UCSR0B |= (1 << TXEN0);            // enable UART with UCSR0B set bit3 TXEN0 to start transmitting
-
-    for (byteCount = 1; byteCount < PIXELBYTES; byteCount++)
-    {
-        // loop on UCSR0A:  bit.5 - UDRE0 to see if UDR0 is ready to receive another byte
-        loop_until_bit_is_set(UCSR0A, UDRE0);
-
-        // invert and send data bytes though UART register UDR0
-        UDR0 = ~(videoRAM[videoRamIndex+byteCount]);
-    }
+    __asm__ __volatile__ (
+        "lds    r30, rowSetup       \n\t"     // Z = row table entry
+        "lds    r31, rowSetup+1     \n\t"
+        "ld     r26, Z              \n\t"     // X = row pixel bytes
+        "ldd    r27, Z+1            \n\t"
+        "ldd    r18, Z+%[first]     \n\t"     // background bytes
+        "ldd    r19, Z+%[middle]    \n\t"
+        "ldd    r20, Z+%[net]       \n\t"
+        "ldd    r21, Z+%[last]      \n\t"
+        "lds    r22, netByte        \n\t"
+        "ld     r25, X+             \n\t"     // first pixel byte with its background, inverted
+        "or     r25, r18            \n\t"
+        "com    r25                 \n\t"
+        "ldi    r23, hi8(%[start])  \n\t"
+
+        // the scan line ISR is shorter than h-sync plus back-porch,
+        // hold the first pixel until the back-porch ends so the picture's left edge is fixed
+        "1:                         \n\t"
+        "lds    r24, %[tcntl]       \n\t"     // TCNT1, low byte first
+        "lds    r18, %[tcnth]       \n\t"
+        "cpi    r24, lo8(%[start])  \n\t"
+        "cpc    r18, r23            \n\t"
+        "brlo   1b                  \n\t"
+
+        // send first data byte to USART to set up transmitter buffer,
+        // then enable UART with UCSR0B set bit3 TXEN0 to start transmitting
+        "sts    %[udr], r25         \n\t"
+        "lds    r24, %[ucsrb]       \n\t"
+        "ori    r24, %[txen]        \n\t"
+        "sts    %[ucsrb], r24       \n\t"
+
+        // middle bytes, the net byte gets the net background
+        "ldi    r24, 1              \n\t"     // byte column
+        "2:                         \n\t"
+        "ld     r25, X+             \n\t"
+        "mov    r18, r19            \n\t"
+        "cpse   r24, r22            \n\t"
+        "rjmp   3f                  \n\t"
+        "mov    r18, r20            \n\t"
+        "3:                         \n\t"
+        "or     r25, r18            \n\t"
+        "com    r25                 \n\t"
+        "4:                         \n\t"
+        "lds    r0, %[ucsra]        \n\t"     // loop on UCSR0A: bit.5 - UDRE0 to see if UDR0 is ready to receive another byte
+        "sbrs   r0, %[udre]         \n\t"
+        "rjmp   4b                  \n\t"
+        "sts    %[udr], r25         \n\t"
+        "inc    r24                 \n\t"
+        "cpi    r24, %[lastbyte]    \n\t"
+        "brne   2b                  \n\t"
+
+        // last byte
+        "ld     r25, X              \n\t"
+        "or     r25, r21            \n\t"
+        "com    r25                 \n\t"
+        "5:                         \n\t"
+        "lds    r0, %[ucsra]        \n\t"
+        "sbrs   r0, %[udre]         \n\t"
+        "rjmp   5b                  \n\t"
+        "sts    %[udr], r25         \n\t"
+        "6:                         \n\t"
+        "lds    r0, %[ucsra]        \n\t"
+        "sbrs   r0, %[udre]         \n\t"
+        "rjmp   6b                  \n\t"
+        "sts    %[udr], r1          \n\t"     // stuff shift register with 0 (8 pixels of black)
+
+        // while the last data byte shifts out, account for render repeat
+        // and move to the next row table entry
+        "lds    r24, lineRepeat     \n\t"
+        "inc    r24                 \n\t"
+        "cpi    r24, %[repeat]      \n\t"
+        "brne   7f                  \n\t"
+        "adiw   r30, %[rowsize]     \n\t"
+        "sts    rowSetup, r30       \n\t"
+        "sts    rowSetup+1, r31     \n\t"
+        "clr    r24                 \n\t"
+        "7:                         \n\t"
+        "sts    lineRepeat, r24     \n\t"
+
+        // check UDRE0 bit, when this bit is set the last *data* byte has been sent
+        // and the '0'-stuffing is in the shift register so we can shut down the Tx
+        "8:                         \n\t"
+        "lds    r0, %[ucsra]        \n\t"
+        "sbrs   r0, %[udre]         \n\t"
+        "rjmp   8b                  \n\t"
+        "lds    r24, %[ucsrb]       \n\t"     // clear bit3 TXEN0 to disable transmitter and allow PD1 to go to 'lo'
+        "andi   r24, %[txenoff]     \n\t"
+        "sts    %[ucsrb], r24       \n\t"
+        "lds    r24, %[ucsra]       \n\t"     // manually clear UCSR0A bit 6 - TXC0
+        "ori    r24, %[txc]         \n\t"
+        "sts    %[ucsra], r24       \n\t"
+        RENDERLATCH
+        "ret                        \n\t"
+        :: [first]    "n" (offsetof(rowsetup_t, first)),
+           [middle]   "n" (offsetof(rowsetup_t, middle)),
+           [net]      "n" (offsetof(rowsetup_t, net)),
+           [last]     "n" (offsetof(rowsetup_t, last)),
+           [rowsize]  "n" (sizeof(rowsetup_t)),
+           [start]    "n" (PIXELSTART),
+           [lastbyte] "n" (PIXELBYTES - 1),
+           [repeat]   "n" (LINESPERROW),
+           [tcntl]    "n" (_SFR_MEM_ADDR(TCNT1L)),
+           [tcnth]    "n" (_SFR_MEM_ADDR(TCNT1H)),
+           [udr]      "n" (_SFR_MEM_ADDR(UDR0)),
+           [ucsra]    "n" (_SFR_MEM_ADDR(UCSR0A)),
+           [ucsrb]    "n" (_SFR_MEM_ADDR(UCSR0B)),
+           [udre]     "n" (UDRE0),
+           [txen]     "n" (1 << TXEN0),
+           [txenoff]  "n" ((uint8_t) ~(1 << TXEN0)),
+           [txc]      "n" (1 << TXC0)
+    );
+}
 
-    UDR0 = 0;               // stuff shift register with 0 (8 pixels of black)
-    
-    // check UDRE0 bit, when this bit is set the last *data* byte has been sent
-    // and the '0'-stuffing is in the shift register so we can shut down the Tx
-    loop_until_bit_is_set(UCSR0A, UDRE0);
+/* ----------------------------------------------------------------------------
+ * renderarm()
+ *
+ *  hooked by the phase ISR on the blank line before the active window,
+ *  hook renderer() so it runs from the next line, FIRSTLINE, after the short scan line ISR
+ *
+ */
+void renderarm(void)
+{
+    activeFunction = &renderer;
+}
 
-    // use UCSR0B clear bit3 TXEN0 to disable transmitter and allow PD1 to go to 'lo'
-    UCSR0B &= ~(1 << TXEN0);
+/* ----------------------------------------------------------------------------
+ * playgame()
+ *
+ *  run one field of game logic on the game state, flip a committed region buffer
+ *  and rebuild the row table, then hook in an idle activity until the next field.
+ *  no row is rendered until RENDERARM, so the flip and the table never change under renderer().
+ *  the renderer() end time latched on the last rendered line is added
+ *  to the performance monitor statistics here, outside the scan line budget
+ *
+ */
+void playgame(void)
+{
+    uint8_t     *front;
 
-    // manually clear UCSR0A bit 6 - TXC0
-    UCSR0A |= (1 << TXC0);
+#ifdef PERFMON
+    perfsample(PERF_RENDER, renderEnd);
+#endif
+    game(&pong, &screen);
 
-    // move pointer to next video buffer line and account for render repeat
-    // line render repeat loop
-    if ( lineRepeat < RENDERREP )
+    if ( region.commit )
     {
-        lineRepeat++;
-    }
-    else
-    {
-        lineRepeat = 0;
-        videoRamIndex += PIXELBYTES;
-        if ( videoRamIndex == VIDEORAM )
-            videoRamIndex = 0;
+        front         = region.front;
+        region.front  = region.back;
+        region.back   = front;
+        region.commit = 0;
     }
+    setuprows();
+
+    activeFunction = &idle;
 }
 
 /* ----------------------------------------------------------------------------
@@ -237,28 +646,32 @@ void idle(void)
  */
 int main(void)
 {
-    uint8_t i;
-
     // initialize globals
-    scanLine       = 0;
-    videoRamIndex  = 0;
+    // first line interrupt enters the render phase
+    GPIOR1         = PHASES - 1;
+    GPIOR0         = 1;
     lineRepeat     = 0;
+    bgLayer        = &board;
+    setuprows();
+    rowSetup       = rowTable;
     activeFunction = &idle;
 
     // initialize video RAM buffer and game board
-    videoinit(videoRAM, PIXELSX, PIXELSY);
-    clear(0);
-
-    line(0,TOP,(PIXELSX-1),TOP);        // top line
-    line(0,BOTTOM,(PIXELSX-1),BOTTOM);  // bottom line
-    for (i = 1; i < PIXELSY; i += 4)    // dashed line down the middle
-    {
-        line((PIXELSX/2),i,(PIXELSX/2),i+1);
-    }
-    line(LPADCOL,(LPADINIT-HALFPAD),LPADCOL,(LPADINIT+HALFPAD));    // draw left paddles
-    line(RPADCOL,(RPADINIT-HALFPAD),RPADCOL,(RPADINIT+HALFPAD));    // draw right paddles
-    writechar((PIXELSX/2)+LEFTSCORE,3,'0');                         // print initial score
-    writechar((PIXELSX/2)+RIGHTSCORE,3,'0');
+    // walls and the dashed line down the middle are rendered from the 'board' background descriptor
+    videoinit(&screen, videoRAM, PIXELSX, PIXELSY);
+    videobackground(&screen, &bgbyte);
+    clear(&screen, 0);
+    gameinit(&pong);
+
+    line(&screen,LPADCOL,(LPADINIT-HALFPAD),LPADCOL,(LPADINIT+HALFPAD)); // draw left paddles
+    line(&screen,RPADCOL,(RPADINIT-HALFPAD),RPADCOL,(RPADINIT+HALFPAD)); // draw right paddles
+    writechar(&screen,(PIXELSX/2)+LEFTSCORE,3,'0');                      // print initial score
+    writechar(&screen,(PIXELSX/2)+RIGHTSCORE,3,'0');
+
+#ifdef PERFMON
+    // performance monitor, game() budget is the lines between end of render and start of next field
+    perfinit(LINECYCLES, LINESINFIELD, ((uint32_t) GAMELINES * LINECYCLES));
+#endif
 
     // on M328p needs the watch-dog timeout flag cleared (why?)
     MCUSR &= ~(1<<WDRF);
@@ -274,11 +687,16 @@ int main(void)
     // enable interrupts
     sei();
 
-    while (1)
-    {
-        sleep_cpu();            // sleep
-        (*activeFunction)();
-    }
+    // sleep and call the active function after every scan line interrupt,
+    // in assembly so the cycles from the interrupt to renderer() are fixed (ISRCYCLES in videotiming.h)
+    __asm__ __volatile__ (
+        "1:                             \n\t"
+        "sleep                          \n\t"
+        "lds    r30, activeFunction     \n\t"
+        "lds    r31, activeFunction+1   \n\t"
+        "icall                          \n\t"
+        "rjmp   1b                      \n\t"
+    );
 
     return 0;
 }
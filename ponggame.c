@@ -10,17 +10,16 @@
 #include    <avr/pgmspace.h>
 #include    <avr/io.h>
 
+#include    "videotiming.h"
 #include    "videoutil.h"
 #include    "ponggame.h"
+#include    "perfmon.h"
 
 /* ----------------------------------------------------------------------------
  * global definitions
  */
 #define     SERVECYCLE      20              // counter max value used to "randomize" serve direction
 #define     BALLVELOCITY    2               // ball velocity: 1=fast .. 10=slow (i.e. if =1 ball moves every 16.6mSec, =10 every 166.3mSec etc.)
-#define     NOSERVE         0               // serve flag and direction
-#define     RIGHTSERVE      1
-#define     LEFTSERVE       2
 #define     UP              0               // serve direction
 #define     DOWN            1
 #define     NONE            0               // flag score status
@@ -33,69 +32,63 @@
 #define     SOUNDPADDLE     3
 #define     SOUNDWALL       4
 
-#define     BEEPOUT         61              // 250Hz  <-- OCR0A values for sound
-#define     BEEPPADDLE      10              // 1500Hz
-#define     BEEPWALL        6               // 2000Hz
 #define     SOUNDON         0x04            // TCCR0B to turn 'on' sound, 0x00 for 'off'
 
 #define     LONGBEEP        30              // 500mSec  ( x field refresh cycles os 16.6mSec)
 #define     SHORTBEEP       6               // 100mSec
 
 /* ----------------------------------------------------------------------------
- * global variables
- */
-
-// game paddle
-uint8_t     rightPaddle;                    // ADO paddle readings
-uint8_t     leftPaddle;
-uint8_t     rightPadTarget;                 // paddle center on screen pixel
-uint8_t     curRightPadCenter = RPADINIT;
-uint8_t     leftPadTarget;
-uint8_t     curLeftPadCenter = LPADINIT;
-
-// score keeping
-uint8_t     leftScore = 0;                  // score variable
-uint8_t     rightScore = 0;
-uint8_t     scoringFlag = NONE;             // score flag: NONE, LEFT, RIGHT
-
-// sound generator
-uint8_t     soundDuration = 0;              // increments on 16.6mSec (frame rate)
-uint8_t     soundFlag   = SOUNDOFF;         // sound type flag
-
-// ball movement
-int         ballX0, ballY0;                 // start and end coordinates of ball movement trajectory line
-int         ballX1, ballY1;
-int         dx, sx;                         // Bresenham's line algorithm variables,
-int         dy, sy;                         // these are globals so that ball position is maintained between calls to game()
-int         err, e2;
-int         serveOffset = -SERVECYCLE;      // cycles from 1 to SERVECYCLE and used to pick serve direction (X1,Y1)
-uint8_t     serveDir = UP;                  // serve direction UP or DOWN
-uint8_t     ballSkipCycles = 0;             // skip-process cycle count to slow ball movement
-uint8_t     serveFlag = 1;                  // is it time to serve a new game? 0=no, 1=from-right, 2=from-left
-
-extern void (*activeFunction)(void);
-
-/* ----------------------------------------------------------------------------
- * function definitions
+ * gameinit()
+ *
+ *  set game state for a new game: paddles at their initial location,
+ *  scores zeroed and the first serve from the right player
+ *
  */
-extern void idle(void);
+void gameinit(game_t* g)
+{
+    g->curRightPadCenter = RPADINIT;
+    g->curLeftPadCenter  = LPADINIT;
+    g->leftScore         = 0;
+    g->rightScore        = 0;
+    g->scoringFlag       = NONE;
+    g->soundDuration     = 0;
+    g->soundFlag         = SOUNDOFF;
+    g->ballX0 = g->ballY0 = 0;
+    g->ballX1 = g->ballY1 = 0;
+    g->dx = g->sx = g->dy = g->sy = 0;
+    g->err               = 0;
+    g->serveOffset       = -SERVECYCLE;
+    g->serveDir          = UP;
+    g->ballSkipCycles    = 0;
+    g->serveFlag         = RIGHTSERVE;
+}
 
 /* ----------------------------------------------------------------------------
  * game()
  *
  *  this routine include all the Pong game logic:
- *  - it must complete within the time alloted for v-sync pulses:
- *    22 lines x 63.5uSec = 1,300 uSec
+ *  - it must complete within the time alloted for the blank lines outside the
+ *    active window and the v-sync pulses:
+ *    GAMELINES (75 lines with the default board) x 63.5uSec = 4,760 uSec
  *  - the function can be broken into multiple sections and each section run in turn
  *    by using an 'invocation' counter and a switch-case construct.
  *  - the function is invoked every 16.6mSec / 60Hz
+ *  - all game state is in the game_t pointed to by 'g' and the game is drawn
+ *    into video buffer 'v', the caller hooks the next activity when game() returns
  *
  */
-void game(void)
+void game(game_t* g, video_t* v)
 {
+    uint8_t     rightPaddle, leftPaddle;    // ADC paddle readings
+    uint8_t     rightPadTarget;             // paddle center on screen pixel
+    uint8_t     leftPadTarget;
+    int         e2;                         // Bresenham's line algorithm step error
+
     PORTD ^= 0x08;          // assert timing marker
+    PERF_BEGIN(PERF_GAME);
 
     // read game paddles right (ADC0) then left (ADC1)
+    PERF_BEGIN(PERF_ADC);
     ADMUX  &= ~(1 << MUX0);                 // select ADC0
     ADCSRA |= (1 << ADEN);                  // enable ADC converter
     ADCSRA |= (1 << ADSC);                  // start convention of ADC0
@@ -111,25 +104,27 @@ void game(void)
     ADCSRA |= (1 << ADIF);                  // clear conversion complete flag
     leftPaddle = ADCH;                      // read ADC
     ADCSRA &= ~(1 << ADEN);                 // disable ADC converter
+    PERF_END(PERF_ADC);
 
     // process paddle movement
+    PERF_BEGIN(PERF_PADDLE);
     rightPadTarget = (rightPaddle / 5) + 5; // scale ADC reading to paddle movement range: 0-255 -> 5-56
     leftPadTarget = (leftPaddle / 5) + 5;
 
     // right paddle
-    if ( curRightPadCenter > rightPadTarget )
+    if ( g->curRightPadCenter > rightPadTarget )
     {
         // move paddle up
-        pflip(RPADCOL,(curRightPadCenter+HALFPAD));
-        curRightPadCenter--;
-        pflip(RPADCOL,(curRightPadCenter-HALFPAD));
+        pflip(v, RPADCOL,(g->curRightPadCenter+HALFPAD));
+        g->curRightPadCenter--;
+        pflip(v, RPADCOL,(g->curRightPadCenter-HALFPAD));
     }
-    else if ( curRightPadCenter < rightPadTarget )
+    else if ( g->curRightPadCenter < rightPadTarget )
     {
         // move paddle down
-        pflip(RPADCOL,(curRightPadCenter-HALFPAD));
-        curRightPadCenter++;
-        pflip(RPADCOL,(curRightPadCenter+HALFPAD));
+        pflip(v, RPADCOL,(g->curRightPadCenter-HALFPAD));
+        g->curRightPadCenter++;
+        pflip(v, RPADCOL,(g->curRightPadCenter+HALFPAD));
     }
     else
     {
@@ -137,220 +132,229 @@ void game(void)
     }
 
     // left paddle
-    if ( curLeftPadCenter > leftPadTarget )
+    if ( g->curLeftPadCenter > leftPadTarget )
     {
         // move paddle up
-        pflip(LPADCOL,(curLeftPadCenter+HALFPAD));
-        curLeftPadCenter--;
-        pflip(LPADCOL,(curLeftPadCenter-HALFPAD));
+        pflip(v, LPADCOL,(g->curLeftPadCenter+HALFPAD));
+        g->curLeftPadCenter--;
+        pflip(v, LPADCOL,(g->curLeftPadCenter-HALFPAD));
     }
-    else if ( curLeftPadCenter < leftPadTarget )
+    else if ( g->curLeftPadCenter < leftPadTarget )
     {
         // move paddle down
-        pflip(LPADCOL,(curLeftPadCenter-HALFPAD));
-        curLeftPadCenter++;
-        pflip(LPADCOL,(curLeftPadCenter+HALFPAD));
+        pflip(v, LPADCOL,(g->curLeftPadCenter-HALFPAD));
+        g->curLeftPadCenter++;
+        pflip(v, LPADCOL,(g->curLeftPadCenter+HALFPAD));
     }
     else
     {
         // do nothing paddle on target, not moving
     }
+    PERF_END(PERF_PADDLE);
 
     // process ball movement
-    ballSkipCycles++;                           // increment process-skip counter
-    if ( ballSkipCycles == BALLVELOCITY )       // check if it is time to move ball one more pixel
+    g->ballSkipCycles++;                        // increment process-skip counter
+    if ( g->ballSkipCycles == BALLVELOCITY )    // check if it is time to move ball one more pixel
     {
-        ballSkipCycles = 0;                     // reset process-skip counter
-        pflip(ballX0, ballY0);                  // clear current ball location
+        PERF_BEGIN(PERF_BALL);
+        g->ballSkipCycles = 0;                  // reset process-skip counter
+        pflip(v, g->ballX0, g->ballY0);         // clear current ball location
 
-        serveOffset++;                          // use this to generate some randomness in ball serving angle
-        if (serveOffset > SERVECYCLE )
-            serveOffset = -SERVECYCLE;
-        serveDir = (serveDir==UP) ? DOWN : UP;  // switch serve direction
+        g->serveOffset++;                       // use this to generate some randomness in ball serving angle
+        if (g->serveOffset > SERVECYCLE )
+            g->serveOffset = -SERVECYCLE;
+        g->serveDir = (g->serveDir==UP) ? DOWN : UP; // switch serve direction
 
         // ball movement and action state machine
-        switch ( serveFlag )                    // determine what to do with the next move
+        switch ( g->serveFlag )                 // determine what to do with the next move
         {
         // no serve, just move the ball and check for
         // collision with wall or paddle
         case NOSERVE:
             // check if ball reached edge of screen
             // this means that the paddle was missed
-            if ( ballX0 == (RPADCOL+1))
+            if ( g->ballX0 == (RPADCOL+1))
             {
-                preset(ballX0, ballY0);         // make sure ball is cleared
-                scoringFlag = LEFT;             // left player scored
-                soundFlag = SOUNDOUT;
-                serveFlag = LEFTSERVE;          // next serve from left player
+                preset(v, g->ballX0, g->ballY0); // make sure ball is cleared
+                g->scoringFlag = LEFT;          // left player scored
+                g->soundFlag = SOUNDOUT;
+                g->serveFlag = LEFTSERVE;       // next serve from left player
             }
-            else if ( ballX0 == (LPADCOL-1))
+            else if ( g->ballX0 == (LPADCOL-1))
             {
-                preset(ballX0, ballY0);         // make sure ball is cleared
-                scoringFlag = RIGHT;            // right player scored
-                soundFlag = SOUNDOUT;
-                serveFlag = RIGHTSERVE;         // next serve from right player
+                preset(v, g->ballX0, g->ballY0); // make sure ball is cleared
+                g->scoringFlag = RIGHT;         // right player scored
+                g->soundFlag = SOUNDOUT;
+                g->serveFlag = RIGHTSERVE;      // next serve from right player
             }
             // ball reached one of the paddles
-            else if ( ballX0 == (LPADCOL+1) &&
-                 ballY0 <= (curLeftPadCenter+HALFPAD) &&
-                 ballY0 >= (curLeftPadCenter-HALFPAD))
+            else if ( g->ballX0 == (LPADCOL+1) &&
+                 g->ballY0 <= (g->curLeftPadCenter+HALFPAD) &&
+                 g->ballY0 >= (g->curLeftPadCenter-HALFPAD))
             {
-                ballX0 -= sx;
-                ballY0 += sy;
-                ballY1 = (sy == 1) ? (BOTTOM-1) : (TOP+1);
-                ballX1 = ballX0 + ((-1 * sx * abs(ballY0-ballY1) * dx) / dy);
-                dx = abs(ballX1-ballX0);        // Bresenman algorithm initialization
-                sx = ballX0<ballX1 ? 1 : -1;
-                dy = abs(ballY1-ballY0);
-                sy = ballY0<ballY1 ? 1 : -1;
-                err = (dx>dy ? dx : -dy)/2;
-                soundFlag = SOUNDPADDLE;
-                serveFlag = NOSERVE;
+                g->ballX0 -= g->sx;
+                g->ballY0 += g->sy;
+                g->ballY1 = (g->sy == 1) ? (BOTTOM-1) : (TOP+1);
+                g->ballX1 = g->ballX0 + ((-1 * g->sx * abs(g->ballY0-g->ballY1) * g->dx) / (g->dy ? g->dy : 1)); // dy=0 would divide by zero
+                g->dx = abs(g->ballX1-g->ballX0); // Bresenman algorithm initialization
+                g->sx = g->ballX0<g->ballX1 ? 1 : -1;
+                g->dy = abs(g->ballY1-g->ballY0);
+                g->sy = g->ballY0<g->ballY1 ? 1 : -1;
+                g->err = (g->dx>g->dy ? g->dx : -g->dy)/2;
+                g->soundFlag = SOUNDPADDLE;
+                g->serveFlag = NOSERVE;
             }
-            else if ( ballX0 == (RPADCOL-1) &&
-                      ballY0 <= (curRightPadCenter+HALFPAD) &&
-                      ballY0 >= (curRightPadCenter-HALFPAD))
+            else if ( g->ballX0 == (RPADCOL-1) &&
+                      g->ballY0 <= (g->curRightPadCenter+HALFPAD) &&
+                      g->ballY0 >= (g->curRightPadCenter-HALFPAD))
             {
-                ballX0 -= sx;
-                ballY0 += sy;
-                ballY1 = (sy == 1) ? (BOTTOM-1) : (TOP+1);
-                ballX1 = ballX0 + ((-1 * sx * abs(ballY0-ballY1) * dx) / dy);
-                dx = abs(ballX1-ballX0);        // Bresenman algorithm initialization
-                sx = ballX0<ballX1 ? 1 : -1;
-                dy = abs(ballY1-ballY0);
-                sy = ballY0<ballY1 ? 1 : -1;
-                err = (dx>dy ? dx : -dy)/2;
-                soundFlag = SOUNDPADDLE;
-                serveFlag = NOSERVE;
+                g->ballX0 -= g->sx;
+                g->ballY0 += g->sy;
+                g->ballY1 = (g->sy == 1) ? (BOTTOM-1) : (TOP+1);
+                g->ballX1 = g->ballX0 + ((-1 * g->sx * abs(g->ballY0-g->ballY1) * g->dx) / (g->dy ? g->dy : 1)); // dy=0 would divide by zero
+                g->dx = abs(g->ballX1-g->ballX0); // Bresenman algorithm initialization
+                g->sx = g->ballX0<g->ballX1 ? 1 : -1;
+                g->dy = abs(g->ballY1-g->ballY0);
+                g->sy = g->ballY0<g->ballY1 ? 1 : -1;
+                g->err = (g->dx>g->dy ? g->dx : -g->dy)/2;
+                g->soundFlag = SOUNDPADDLE;
+                g->serveFlag = NOSERVE;
             }
             // reached top or bottom of game board
             // reverse Y trajectory of ball
-            else if ( ballY0 == (TOP+1) || ballY0 == (BOTTOM-1) )
+            else if ( g->ballY0 == (TOP+1) || g->ballY0 == (BOTTOM-1) )
             {
-                ballX0 += sx;
-                ballY0 -= sy;
-                ballX1 = (sx == 1) ? (RPADCOL+1) : (LPADCOL-1);
-                ballY1 = ballY0 + ((-1 * sy * abs(ballX0-ballX1) * dy) / dx);
-                dx = abs(ballX1-ballX0);        // Bresenman algorithm initialization
-                sx = ballX0<ballX1 ? 1 : -1;
-                dy = abs(ballY1-ballY0);
-                sy = ballY0<ballY1 ? 1 : -1;
-                err = (dx>dy ? dx : -dy)/2;
-                soundFlag = SOUNDWALL;
-                serveFlag = NOSERVE;
+                g->ballX0 += g->sx;
+                g->ballY0 -= g->sy;
+                g->ballX1 = (g->sx == 1) ? (RPADCOL+1) : (LPADCOL-1);
+                g->ballY1 = g->ballY0 + ((-1 * g->sy * abs(g->ballX0-g->ballX1) * g->dy) / (g->dx ? g->dx : 1)); // dx=0 would divide by zero
+                g->dx = abs(g->ballX1-g->ballX0); // Bresenman algorithm initialization
+                g->sx = g->ballX0<g->ballX1 ? 1 : -1;
+                g->dy = abs(g->ballY1-g->ballY0);
+                g->sy = g->ballY0<g->ballY1 ? 1 : -1;
+                g->err = (g->dx>g->dy ? g->dx : -g->dy)/2;
+                g->soundFlag = SOUNDWALL;
+                g->serveFlag = NOSERVE;
             }
             break;
 
         // serve new ball from the right
         case RIGHTSERVE:
-            if ( soundFlag != SOUNDOFF )        // wait for 'out' sound to complete
+            if ( g->soundFlag != SOUNDOFF )     // wait for 'out' sound to complete
                 break;
 
-            ballX0 = RPADCOL-1;                 // serve from center of paddle
-            ballY0 = curRightPadCenter;         // one line into game board
-            ballX1 = (getXres() / 2) + serveOffset;
-            ballY1 = (serveDir==UP) ? (TOP+1) : (BOTTOM-1);
-            dx = abs(ballX1-ballX0);            // Bresenman algorithm initialization
-            sx = ballX0<ballX1 ? 1 : -1;
-            dy = abs(ballY1-ballY0);
-            sy = ballY0<ballY1 ? 1 : -1;
-            err = (dx>dy ? dx : -dy)/2;
-            scoringFlag = NONE;
-            soundFlag = SOUNDPADDLE;
-            serveFlag = NOSERVE;
+            g->ballX0 = RPADCOL-1;              // serve from center of paddle
+            g->ballY0 = g->curRightPadCenter;   // one line into game board
+            g->ballX1 = (getXres(v) / 2) + g->serveOffset;
+            g->ballY1 = (g->serveDir==UP) ? (TOP+1) : (BOTTOM-1);
+            g->dx = abs(g->ballX1-g->ballX0);   // Bresenman algorithm initialization
+            g->sx = g->ballX0<g->ballX1 ? 1 : -1;
+            g->dy = abs(g->ballY1-g->ballY0);
+            g->sy = g->ballY0<g->ballY1 ? 1 : -1;
+            g->err = (g->dx>g->dy ? g->dx : -g->dy)/2;
+            g->scoringFlag = NONE;
+            g->soundFlag = SOUNDPADDLE;
+            g->serveFlag = NOSERVE;
             break;
 
         // serve new ball from the left
         case LEFTSERVE:
-            if ( soundFlag != SOUNDOFF )        // wait for 'out' sound to complete
+            if ( g->soundFlag != SOUNDOFF )     // wait for 'out' sound to complete
                 break;
 
-            ballX0 = LPADCOL+1;                 // serve from center of paddle
-            ballY0 = curLeftPadCenter;          // one line into game board
-            ballX1 = (getXres() / 2) + serveOffset;
-            ballY1 = (serveDir==UP) ? (TOP+1) : (BOTTOM-1);
-            dx = abs(ballX1-ballX0);            // Bresenman algorithm initialization
-            sx = ballX0<ballX1 ? 1 : -1;
-            dy = abs(ballY1-ballY0);
-            sy = ballY0<ballY1 ? 1 : -1;
-            err = (dx>dy ? dx : -dy)/2;
-            scoringFlag = NONE;
-            soundFlag = SOUNDPADDLE;
-            serveFlag = NOSERVE;
+            g->ballX0 = LPADCOL+1;              // serve from center of paddle
+            g->ballY0 = g->curLeftPadCenter;    // one line into game board
+            g->ballX1 = (getXres(v) / 2) + g->serveOffset;
+            g->ballY1 = (g->serveDir==UP) ? (TOP+1) : (BOTTOM-1);
+            g->dx = abs(g->ballX1-g->ballX0);   // Bresenman algorithm initialization
+            g->sx = g->ballX0<g->ballX1 ? 1 : -1;
+            g->dy = abs(g->ballY1-g->ballY0);
+            g->sy = g->ballY0<g->ballY1 ? 1 : -1;
+            g->err = (g->dx>g->dy ? g->dx : -g->dy)/2;
+            g->scoringFlag = NONE;
+            g->soundFlag = SOUNDPADDLE;
+            g->serveFlag = NOSERVE;
             break;
         }
 
-        e2 = err;                               // calculate new ball location
-        if (e2 >-dx) { err -= dy; ballX0 += sx; }
-        if (e2 < dy) { err += dx; ballY0 += sy; }
+        e2 = g->err;                            // calculate new ball location
+        if (e2 >-g->dx) { g->err -= g->dy; g->ballX0 += g->sx; }
+        if (e2 < g->dy) { g->err += g->dx; g->ballY0 += g->sy; }
 
-        if ( serveFlag == NOSERVE )
-            pflip(ballX0, ballY0);              // put ball in new location
+        if ( g->serveFlag == NOSERVE )
+            pflip(v, g->ballX0, g->ballY0);     // put ball in new location
+        PERF_END(PERF_BALL);
 
         // update score
-        switch ( scoringFlag )
+        PERF_BEGIN(PERF_SCORE);
+        switch ( g->scoringFlag )
         {
         case NONE:
             break;
 
         case RIGHT:
-            rightScore++;
-            if (rightScore == 10) rightScore = 0;
-            writechar(((getXres()+1)/2)+RIGHTSCORE,3,('0'+rightScore));
-            scoringFlag = NONE;
+            g->rightScore++;
+            if (g->rightScore == 10) g->rightScore = 0;
+            writechar(v, ((getXres(v)+1)/2)+RIGHTSCORE,3,('0'+g->rightScore));
+            g->scoringFlag = NONE;
             break;
 
         case LEFT:
-            leftScore++;
-            if (leftScore == 10) leftScore = 0;
-            writechar(((getXres()+1)/2)+LEFTSCORE,3,('0'+leftScore));
-            scoringFlag = NONE;
+            g->leftScore++;
+            if (g->leftScore == 10) g->leftScore = 0;
+            writechar(v, ((getXres(v)+1)/2)+LEFTSCORE,3,('0'+g->leftScore));
+            g->scoringFlag = NONE;
             break;
         }
+        PERF_END(PERF_SCORE);
     }
 
     // generate sound
+    PERF_BEGIN(PERF_SOUND);
 
     // sound management state-machine
-    switch ( soundFlag )
+    switch ( g->soundFlag )
     {
     case SOUNDOFF:
         TCCR0B = 0;                         // turn off sound
         break;
 
     case SOUNDACTIVE:                       // sound already on
-        soundDuration--;                    // decrement duration and check for end
-        if (soundDuration == 0 )
-            soundFlag = SOUNDOFF;
+        g->soundDuration--;                 // decrement duration and check for end
+        if (g->soundDuration == 0 )
+            g->soundFlag = SOUNDOFF;
         break;
 
     case SOUNDPADDLE:
-        soundDuration = SHORTBEEP;          // setup sound for paddle touch
+        g->soundDuration = SHORTBEEP;       // setup sound for paddle touch
         TCNT0 = 0;
         OCR0A = BEEPPADDLE;
         TCCR0B = SOUNDON;
-        soundFlag = SOUNDACTIVE;
+        g->soundFlag = SOUNDACTIVE;
         break;
 
     case SOUNDWALL:
-        soundDuration = SHORTBEEP;          // setup sound for wall touch
+        g->soundDuration = SHORTBEEP;       // setup sound for wall touch
         TCNT0 = 0;
         OCR0A = BEEPWALL;
         TCCR0B = SOUNDON;
-        soundFlag = SOUNDACTIVE;
+        g->soundFlag = SOUNDACTIVE;
         break;
 
     case SOUNDOUT:
-        soundDuration = LONGBEEP;           // setup sound for ball out (score)
+        g->soundDuration = LONGBEEP;        // setup sound for ball out (score)
         TCNT0 = 0;
         OCR0A = BEEPOUT;
         TCCR0B = SOUNDON;
-        soundFlag = SOUNDACTIVE;
+        g->soundFlag = SOUNDACTIVE;
         break;
     }
+    PERF_END(PERF_SOUND);
 
-    // game work is done so hook in an idle activity
-    activeFunction = &idle;
+    PERF_END(PERF_GAME);
+#ifdef PERFHUD
+    perfhud(v, BOTTOM+1);   // draw HUD in the spare rows below the game board
+#endif
 
     PORTD ^= 0x08;          // reset timing marker
 }
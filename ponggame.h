@@ -17,4 +17,64 @@
 #define     LPADCOL     1           // column for left paddle
 #define     HALFPAD     3           // half paddle height
 
+#define     NOSERVE     0           // serve flag and direction
+#define     RIGHTSERVE  1
+#define     LEFTSERVE   2
+
+// Timer0 OCR0A values of the beeps, game() clears TCNT0 when it starts one,
+// include videotiming.h first for SYSTEMCLK
+#if ( SYSTEMCLK == 8000000UL )
+#define     BEEPOUT     61          // 250Hz, hand-tuned at 8MHz
+#define     BEEPPADDLE  10          // 1500Hz
+#define     BEEPWALL    6           // 2000Hz
+#else
+#define     TONE(hz)    ((((SYSTEMCLK / 512UL) + ((hz) / 2)) / (hz)) - 1)   // nearest value for a tone with Timer0 Fclk/256 toggle
+#define     BEEPOUT     TONE(250)   // 250Hz
+#define     BEEPPADDLE  TONE(1500)  // 1500Hz
+#define     BEEPWALL    TONE(2000)  // 2000Hz
+#endif
+
+/* ----------------------------------------------------------------------------
+ *  types
+ *
+ *  complete state of one game, passed by pointer to gameinit() and game()
+ *  so that the same code can run independent game instances.
+ *  board coordinates fit 8 bits, the trajectory end point and the Bresenham's
+ *  line algorithm deltas are 16 bits because the end point is extended past the board.
+ *  the structure is well under 64 bytes, so every field is reached with an
+ *  LDD/STD displacement from the pointer register.
+ */
+typedef struct
+{
+    // ball movement
+    int8_t      ballX0, ballY0;             // ball location, start of ball movement trajectory line
+    int8_t      sx, sy;                     // Bresenham's line algorithm step direction
+    int16_t     ballX1, ballY1;             // end of ball movement trajectory line
+    int16_t     dx, dy;                     // Bresenham's line algorithm variables,
+    int16_t     err;                        // kept here so that ball position is maintained between calls to game()
+    int8_t      serveOffset;                // cycles from -SERVECYCLE to SERVECYCLE and used to pick serve direction (X1,Y1)
+    uint8_t     serveDir;                   // serve direction UP or DOWN
+    uint8_t     ballSkipCycles;             // skip-process cycle count to slow ball movement
+    uint8_t     serveFlag;                  // is it time to serve a new game? 0=no, 1=from-right, 2=from-left
+
+    // game paddles
+    uint8_t     curRightPadCenter;          // paddle center on screen pixel
+    uint8_t     curLeftPadCenter;
+
+    // score keeping
+    uint8_t     leftScore;                  // score variable
+    uint8_t     rightScore;
+    uint8_t     scoringFlag;                // score flag: NONE, LEFT, RIGHT
+
+    // sound generator
+    uint8_t     soundDuration;              // decrements on 16.6mSec (frame rate)
+    uint8_t     soundFlag;                  // sound type flag
+} game_t;
+
+/* ----------------------------------------------------------------------------
+ *  function prototypes
+ */
+void    gameinit(game_t*);                  // set up a new game
+void    game(game_t*, video_t*);            // run one field of game logic, draw into the video buffer
+
 #endif /* __PONGGAME_H__ */
@@ -0,0 +1,40 @@
+/* io.h
+ *
+ * host stub of <avr/io.h> for the game simulation build (tools/pongsim.c)
+ * only the registers used by ponggame.c exist, every simulation thread
+ * has its own copy, and ADCH returns the paddle reading of the selected channel
+ *
+ */
+
+#ifndef __HOST_AVR_IO_H__
+#define __HOST_AVR_IO_H__
+
+#include    <stdint.h>
+
+/* ----------------------------------------------------------------------------
+ *  stub registers, defined in tools/pongsim.c
+ */
+extern __thread volatile uint8_t PORTD;
+extern __thread volatile uint8_t ADMUX;
+extern __thread volatile uint8_t ADCSRA;
+extern __thread volatile uint8_t TCCR0B;
+extern __thread volatile uint8_t TCNT0;
+extern __thread volatile uint8_t OCR0A;
+
+uint8_t     simadc(void);                   // paddle reading of the ADC channel selected in ADMUX
+
+#define     ADCH            (simadc())
+
+/* ----------------------------------------------------------------------------
+ *  register bits
+ */
+#define     MUX0            0
+#define     ADIF            4
+#define     ADSC            6
+#define     ADEN            7
+
+#define     _BV(bit)                    (1 << (bit))
+#define     bit_is_set(sfr, bit)        ((sfr) & _BV(bit))
+#define     loop_until_bit_is_set(sfr, bit) do { } while ( !bit_is_set(sfr, bit) )
+
+#endif /* __HOST_AVR_IO_H__ */
@@ -0,0 +1,17 @@
+/* pgmspace.h
+ *
+ * host stub of <avr/pgmspace.h> for the game simulation build (tools/pongsim.c)
+ * flash and RAM share one address space on the host
+ *
+ */
+
+#ifndef __HOST_AVR_PGMSPACE_H__
+#define __HOST_AVR_PGMSPACE_H__
+
+#include    <stdint.h>
+
+#define     PROGMEM
+#define     pgm_read_byte(addr)     (*(const uint8_t*) (addr))
+#define     pgm_read_word(addr)     (*(const uint16_t*) (addr))
+
+#endif /* __HOST_AVR_PGMSPACE_H__ */
@@ -0,0 +1,321 @@
+/* imgenc.c
+ *
+ * host tool: encode a black and white PBM image into the compressed image
+ * format decoded by imagestart()/imagestep() in videoutil.c
+ * output is C source with a PROGMEM array that can be added to the firmware
+ *
+ * build:   gcc -O2 -o imgenc tools/imgenc.c
+ * usage:   imgenc <image.pbm> <array name> [> image.h]
+ *
+ * input is a PBM file (P1 text or P4 binary) up to 255 rows, '1' pixels are white.
+ * image width is padded to a multiple of 8 pixels, and must match the
+ * video buffer width (88 pixels for pong) to be decoded.
+ *
+ * format: { rows, bytes per row, row codes .. }
+ *   0x00-0x7f  (n+1) literal bytes follow
+ *   0x80-0xbf  the next byte is repeated (n+1) times
+ *   0xc0-0xff  (n+1) bytes are copied from the row above
+ * codes never cross a row boundary, so the decoder can stop and resume on any row
+ *
+ */
+
+#include    <stdio.h>
+#include    <stdlib.h>
+#include    <stdint.h>
+#include    <string.h>
+#include    <ctype.h>
+
+/* ----------------------------------------------------------------------------
+ * global definitions
+ */
+#define     MAXROWS         255
+#define     MAXBYTES        255
+#define     LITERALMAX      128             // longest literal run
+#define     RUNMAX          64              // longest repeat or copy run
+
+#define     IMGLITERAL      0x00
+#define     IMGREPEAT       0x80
+#define     IMGCOPY         0xc0
+
+/* ----------------------------------------------------------------------------
+ * global variables
+ */
+uint8_t     image[MAXROWS][MAXBYTES];       // source bitmap, MSB is left most pixel
+uint8_t     decoded[MAXROWS][MAXBYTES];     // decoder output for verification
+uint8_t     code[MAXROWS * MAXBYTES * 2 + 2];
+int         rows, bytes;
+
+/* ----------------------------------------------------------------------------
+ * function definitions
+ */
+int     readpbm(const char*);
+int     pbmnumber(FILE*);
+int     encode(void);
+int     decode(int);
+
+/* ----------------------------------------------------------------------------
+ * main()
+ *
+ */
+int main(int argc, char* argv[])
+{
+    int     length;
+    int     i;
+
+    if ( argc != 3 )
+    {
+        fprintf(stderr, "usage: %s <image.pbm> <array name>\n", argv[0]);
+        return 1;
+    }
+
+    if ( !readpbm(argv[1]) )
+        return 1;
+
+    length = encode();
+
+    if ( !decode(length) )
+    {
+        fprintf(stderr, "%s: encoder error, decoded image does not match\n", argv[0]);
+        return 1;
+    }
+
+    printf("/* %s\n *\n * generated by imgenc from %s\n", argv[2], argv[1]);
+    printf(" * %d x %d pixels, %d bytes (%d uncompressed)\n *\n */\n\n", bytes * 8, rows, length, rows * bytes);
+    printf("const uint8_t %s[%d] PROGMEM =\n{", argv[2], length);
+    for (i = 0; i < length; i++)
+    {
+        if ( (i % 12) == 0 )
+            printf("\n    ");
+        printf("0x%02x%s", code[i], (i < length - 1) ? ", " : "");
+    }
+    printf("\n};\n");
+
+    fprintf(stderr, "%s: %d bytes, %.1f%% of %d\n", argv[2], length, (100.0 * length) / (rows * bytes), rows * bytes);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * readpbm()
+ *
+ *  read a P1 or P4 PBM file into image[][]
+ *  return 1 on success, 0 on error
+ *
+ */
+int readpbm(const char* fileName)
+{
+    FILE    *pbm;
+    int     magic;
+    int     width;
+    int     x, y;
+    int     c;
+
+    pbm = fopen(fileName, "rb");
+    if ( pbm == NULL )
+    {
+        fprintf(stderr, "cannot open %s\n", fileName);
+        return 0;
+    }
+
+    if ( fgetc(pbm) != 'P' )
+        magic = 0;
+    else
+        magic = fgetc(pbm);
+
+    width = pbmnumber(pbm);
+    rows  = pbmnumber(pbm);
+    bytes = (width + 7) / 8;
+
+    if ( (magic != '1' && magic != '4') || width <= 0 || rows <= 0 || rows > MAXROWS || bytes > MAXBYTES )
+    {
+        fprintf(stderr, "%s: not a P1/P4 PBM image, or larger than %d rows or %d pixels wide\n", fileName, MAXROWS, MAXBYTES * 8);
+        fclose(pbm);
+        return 0;
+    }
+
+    memset(image, 0, sizeof(image));
+
+    for (y = 0; y < rows; y++)
+    {
+        if ( magic == '4' )
+        {
+            // binary, rows are padded to a byte boundary
+            if ( fread(image[y], 1, bytes, pbm) != (size_t) bytes )
+                break;
+            if ( width % 8 )
+                image[y][bytes - 1] &= (uint8_t) (0xff << (8 - (width % 8)));
+        }
+        else
+        {
+            for (x = 0; x < width; x++)
+            {
+                do
+                {
+                    c = fgetc(pbm);
+                } while ( c != EOF && c != '0' && c != '1' );
+                if ( c == '1' )
+                    image[y][x / 8] |= (0x80 >> (x % 8));
+            }
+        }
+    }
+
+    fclose(pbm);
+
+    if ( y < rows )
+    {
+        fprintf(stderr, "%s: image data is short\n", fileName);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* ----------------------------------------------------------------------------
+ * pbmnumber()
+ *
+ *  read the next decimal number in a PBM header, skip white space and comments
+ *
+ */
+int pbmnumber(FILE* pbm)
+{
+    int     c;
+    int     number = 0;
+
+    do
+    {
+        c = fgetc(pbm);
+        if ( c == '#' )
+            while ( c != '\n' && c != EOF )
+                c = fgetc(pbm);
+    } while ( c != EOF && !isdigit(c) );
+
+    while ( c != EOF && isdigit(c) )
+    {
+        number = (number * 10) + (c - '0');
+        c = fgetc(pbm);
+    }
+
+    return number;
+}
+
+/* ----------------------------------------------------------------------------
+ * encode()
+ *
+ *  encode image[][] into code[], return code length in bytes
+ *  greedy per row: use a copy-from-above run or a repeat run when it
+ *  saves bytes, otherwise extend a literal run
+ *
+ */
+int encode(void)
+{
+    int     length;
+    int     literal;                // index of current literal run code, -1 if none
+    int     x, y;
+    int     copyRun, repeatRun;
+    int     i;
+
+    code[0] = (uint8_t) rows;
+    code[1] = (uint8_t) bytes;
+    length  = 2;
+
+    for (y = 0; y < rows; y++)
+    {
+        literal = -1;
+
+        for (x = 0; x < bytes; )
+        {
+            // measure runs starting at x
+            copyRun = 0;
+            if ( y > 0 )
+                for (i = x; i < bytes && copyRun < RUNMAX && image[y][i] == image[y - 1][i]; i++)
+                    copyRun++;
+
+            repeatRun = 0;
+            for (i = x; i < bytes && repeatRun < RUNMAX && image[y][i] == image[y][x]; i++)
+                repeatRun++;
+
+            // a copy run costs 1 byte and a repeat run 2 bytes,
+            // use them when they are not shorter than the literal bytes they replace
+            if ( copyRun >= 2 || (copyRun == 1 && literal < 0) )
+            {
+                code[length++] = (uint8_t) (IMGCOPY + copyRun - 1);
+                x += copyRun;
+                literal = -1;
+            }
+            else if ( repeatRun >= 3 || (repeatRun == 2 && literal < 0) )
+            {
+                code[length++] = (uint8_t) (IMGREPEAT + repeatRun - 1);
+                code[length++] = image[y][x];
+                x += repeatRun;
+                literal = -1;
+            }
+            else
+            {
+                if ( literal < 0 || code[literal] == (LITERALMAX - 1) )
+                {
+                    literal = length;
+                    code[length++] = IMGLITERAL;
+                }
+                else
+                {
+                    code[literal]++;
+                }
+                code[length++] = image[y][x];
+                x++;
+            }
+        }
+    }
+
+    return length;
+}
+
+/* ----------------------------------------------------------------------------
+ * decode()
+ *
+ *  decode code[] the same way as imagestep() in videoutil.c and compare to image[][]
+ *  return 1 if the decoded image matches
+ *
+ */
+int decode(int length)
+{
+    int     i = 2;
+    int     x, y;
+    int     count;
+    uint8_t c;
+
+    memset(decoded, 0, sizeof(decoded));
+
+    for (y = 0; y < rows; y++)
+    {
+        for (x = 0; x < bytes; )
+        {
+            if ( i >= length )
+                return 0;
+
+            c = code[i++];
+            count = (c & ((c & IMGREPEAT) ? 0x3f : 0x7f)) + 1;
+            if ( count > (bytes - x) )
+                return 0;
+
+            switch ( c & IMGCOPY )
+            {
+            case IMGREPEAT:
+                for ( ; count > 0; count--)
+                    decoded[y][x++] = code[i];
+                i++;
+                break;
+
+            case IMGCOPY:
+                for ( ; count > 0; count--, x++)
+                    decoded[y][x] = (y > 0) ? decoded[y - 1][x] : 0;
+                break;
+
+            default:
+                for ( ; count > 0; count--)
+                    decoded[y][x++] = code[i++];
+            }
+        }
+    }
+
+    return ( i == length && memcmp(image, decoded, sizeof(image)) == 0 );
+}
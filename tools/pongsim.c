@@ -0,0 +1,400 @@
+/* pongsim.c
+ *
+ * host tool: headless batch match runner for the pong game logic
+ * ponggame.c and videoutil.c are built natively against the stub registers in tools/host,
+ * each thread plays its own matches with its own game_t and video_t state, and two
+ * computer players drive the paddle ADC readings.
+ * results are kept per thread without locks and added up after all threads end.
+ *
+ * build:   gcc -O2 -pthread -I. -Itools/host -o pongsim tools/pongsim.c ponggame.c videoutil.c -lm
+ * usage:   pongsim [-t threads] [-m matches] [-p points] [-l error] [-r error] [-s seed]
+ *
+ *  -t  threads, default is the number of CPU cores
+ *  -m  matches to play, default 10000
+ *  -p  points to win a match, 1 to 9, default 9
+ *  -l  left player aim error in pixels, default 4 (paddle is 7 pixels, error above 3 can miss)
+ *  -r  right player aim error in pixels, default 4
+ *  -s  random seed, default 1
+ *
+ */
+
+#include    <stdio.h>
+#include    <stdlib.h>
+#include    <stdint.h>
+#include    <inttypes.h>
+#include    <string.h>
+#include    <math.h>
+#include    <time.h>
+#include    <unistd.h>
+#include    <pthread.h>
+
+#include    <avr/io.h>
+
+#include    "videotiming.h"
+#include    "videoutil.h"
+#include    "ponggame.h"
+
+/* ----------------------------------------------------------------------------
+ * global definitions
+ */
+#define     PIXELSX         88              // video buffer size, same as the firmware
+#define     PIXELSY         (BOTTOM + 3)
+#define     FRAMERATE       60              // game() calls per second on a TV
+#define     MAXFRAMES       500000          // abandon a match that does not end (about 2.3 hours)
+#define     MAXTHREADS      256
+
+#define     RALLYBINS       32              // rally length histogram, last bin is 'or longer'
+#define     ANGLEBINS       18              // serve angle histogram, 5 degree bins 0-90
+#define     SCOREBINS       10
+
+/* ----------------------------------------------------------------------------
+ * types
+ */
+typedef struct
+{
+    pthread_t   thread;
+    int         matches;                    // matches to play
+    uint32_t    seed;
+
+    // results
+    uint64_t    frames;
+    uint64_t    points;
+    int         abandoned;
+    int         leftWins;
+    int         rightWins;
+    uint64_t    rally[RALLYBINS];           // paddle hits per point
+    uint64_t    angle[ANGLEBINS];           // serve angle from horizontal
+    uint64_t    loserScore[SCOREBINS];      // points of the losing player
+} simthread_t;
+
+typedef struct
+{
+    int         error;                      // aim error range in pixels
+    int         offset;                     // current aim offset from the ball
+    int         direction;                  // ball direction the offset was picked for
+} player_t;
+
+/* ----------------------------------------------------------------------------
+ * global variables
+ */
+
+// stub registers, per thread
+__thread volatile uint8_t PORTD;
+__thread volatile uint8_t ADMUX;
+__thread volatile uint8_t ADCSRA;
+__thread volatile uint8_t TCCR0B;
+__thread volatile uint8_t TCNT0;
+__thread volatile uint8_t OCR0A;
+
+__thread uint8_t    adcRight;               // paddle readings returned by ADCH
+__thread uint8_t    adcLeft;
+__thread uint32_t   randomState;            // xorshift state
+
+int         points      = 9;
+int         leftError   = 4;
+int         rightError  = 4;
+
+/* ----------------------------------------------------------------------------
+ * function definitions
+ */
+void*       simulate(void*);
+int         playmatch(simthread_t*, game_t*, video_t*, uint8_t*);
+uint8_t     aim(player_t*, const game_t*, int);
+uint32_t    xorshift(void);
+void        histogram(const char*, const uint64_t*, int, int);
+
+/* ----------------------------------------------------------------------------
+ * main()
+ *
+ */
+int main(int argc, char* argv[])
+{
+    simthread_t     *sim;
+    struct timespec start, end;
+    double          seconds;
+    int             threads;
+    int             matches = 10000;
+    uint32_t        seed = 1;
+    int             opt;
+    int             i, j;
+
+    uint64_t        frames = 0, totalPoints = 0;
+    int             abandoned = 0, leftWins = 0, rightWins = 0;
+    uint64_t        rally[RALLYBINS] = {0}, angle[ANGLEBINS] = {0}, loserScore[SCOREBINS] = {0};
+
+    threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ( (opt = getopt(argc, argv, "t:m:p:l:r:s:")) != -1 )
+    {
+        switch ( opt )
+        {
+        case 't': threads    = atoi(optarg); break;
+        case 'm': matches    = atoi(optarg); break;
+        case 'p': points     = atoi(optarg); break;
+        case 'l': leftError  = atoi(optarg); break;
+        case 'r': rightError = atoi(optarg); break;
+        case 's': seed       = (uint32_t) strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-m matches] [-p points] [-l error] [-r error] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if ( threads < 1 ) threads = 1;
+    if ( threads > MAXTHREADS ) threads = MAXTHREADS;
+    if ( points < 1 || points > 9 || matches < 1 || leftError < 0 || rightError < 0 )
+    {
+        fprintf(stderr, "%s: bad option value\n", argv[0]);
+        return 1;
+    }
+
+    sim = calloc(threads, sizeof(simthread_t));
+    if ( sim == NULL )
+        return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < threads; i++)
+    {
+        sim[i].matches = (matches / threads) + (i < (matches % threads) ? 1 : 0);
+        sim[i].seed    = (seed * 2654435761u) + (uint32_t) i + 1;
+        if ( pthread_create(&sim[i].thread, NULL, simulate, &sim[i]) != 0 )
+        {
+            fprintf(stderr, "%s: cannot start thread %d\n", argv[0], i);
+            return 1;
+        }
+    }
+
+    // join and add up thread results
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(sim[i].thread, NULL);
+
+        frames      += sim[i].frames;
+        totalPoints += sim[i].points;
+        abandoned   += sim[i].abandoned;
+        leftWins    += sim[i].leftWins;
+        rightWins   += sim[i].rightWins;
+        for (j = 0; j < RALLYBINS; j++) rally[j] += sim[i].rally[j];
+        for (j = 0; j < ANGLEBINS; j++) angle[j] += sim[i].angle[j];
+        for (j = 0; j < SCOREBINS; j++) loserScore[j] += sim[i].loserScore[j];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9);
+
+    printf("matches      %d on %d threads, %d points to win, aim error left %d right %d\n",
+           matches, threads, points, leftError, rightError);
+    printf("results      left %d  right %d  abandoned %d\n", leftWins, rightWins, abandoned);
+    printf("game time    %" PRIu64 " frames, %.1f hours at %dHz, %" PRIu64 " points\n",
+           frames, frames / (FRAMERATE * 3600.0), FRAMERATE, totalPoints);
+    printf("run time     %.3f sec, %.0f matches/sec, %.0f frames/sec\n\n",
+           seconds, matches / seconds, frames / seconds);
+
+    histogram("rally length (paddle hits per point)", rally, RALLYBINS, 1);
+    histogram("serve angle (degrees from horizontal)", angle, ANGLEBINS, 5);
+    histogram("loser's final score", loserScore, points, 1);
+
+    free(sim);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * simulate()
+ *
+ *  thread function, play all matches of one thread
+ *
+ */
+void* simulate(void* arg)
+{
+    simthread_t *sim = (simthread_t*) arg;
+    game_t      pong;
+    video_t     video;
+    uint8_t     *videoRAM;
+    int         i;
+
+    videoRAM = malloc((PIXELSX / 8) * PIXELSY);
+    if ( videoRAM == NULL )
+        return NULL;
+
+    randomState = sim->seed ? sim->seed : 1;
+
+    for (i = 0; i < sim->matches; i++)
+    {
+        switch ( playmatch(sim, &pong, &video, videoRAM) )
+        {
+        case 0:  sim->abandoned++; break;
+        case 1:  sim->leftWins++;  break;
+        default: sim->rightWins++; break;
+        }
+    }
+
+    free(videoRAM);
+
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * playmatch()
+ *
+ *  play one match to 'points' points
+ *  return 1 if left player won, 2 if right player won, 0 if abandoned
+ *
+ */
+int playmatch(simthread_t* sim, game_t* g, video_t* v, uint8_t* videoRAM)
+{
+    player_t    left  = { leftError, 0, 0 };
+    player_t    right = { rightError, 0, 0 };
+    int         leftPoints = 0, rightPoints = 0;
+    int         hits = 0;
+    int         frame;
+    uint8_t     lastServe, lastLeft, lastRight;
+    double      degrees;
+
+    videoinit(v, videoRAM, PIXELSX, PIXELSY);
+    clear(v, 0);
+    gameinit(g);
+
+    for (frame = 0; frame < MAXFRAMES; frame++)
+    {
+        adcRight = aim(&right, g, 1);
+        adcLeft  = aim(&left, g, -1);
+        ADCSRA  |= (1 << ADIF);             // conversions complete immediately
+
+        lastServe = g->serveFlag;
+        lastLeft  = g->leftScore;
+        lastRight = g->rightScore;
+        TCNT0     = 1;                      // game() clears Timer0 when it starts a beep
+
+        game(g, v);
+
+        // ball served, record serve angle and start a new rally
+        if ( lastServe != NOSERVE && g->serveFlag == NOSERVE )
+        {
+            degrees = atan2(abs(g->ballY1 - g->ballY0), abs(g->ballX1 - g->ballX0)) * (180.0 / M_PI);
+            sim->angle[((int) (degrees / 5) < ANGLEBINS) ? (int) (degrees / 5) : (ANGLEBINS - 1)]++;
+            hits = 0;
+        }
+        // paddle beep started on this field without a serve, the ball was hit by a paddle
+        else if ( TCNT0 == 0 && OCR0A == BEEPPADDLE )
+        {
+            hits++;
+        }
+
+        // point scored, scores wrap at 10 so look for a change
+        if ( g->leftScore != lastLeft || g->rightScore != lastRight )
+        {
+            if ( g->leftScore != lastLeft )
+                leftPoints++;
+            else
+                rightPoints++;
+            sim->points++;
+            sim->rally[(hits < RALLYBINS) ? hits : (RALLYBINS - 1)]++;
+
+            if ( leftPoints == points || rightPoints == points )
+            {
+                sim->frames += frame + 1;
+                sim->loserScore[(leftPoints < rightPoints) ? leftPoints : rightPoints]++;
+                return (leftPoints == points) ? 1 : 2;
+            }
+        }
+    }
+
+    sim->frames += frame;
+
+    return 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * aim()
+ *
+ *  computer player: follow the ball when it comes towards the player's
+ *  side with a random aim offset picked every time the ball turns,
+ *  return to the center of the board otherwise.
+ *  return the ADC reading that puts the paddle at the target
+ *
+ */
+uint8_t aim(player_t* player, const game_t* g, int side)
+{
+    int     target;
+    int     reading;
+
+    if ( g->serveFlag == NOSERVE && g->sx == side )
+    {
+        if ( player->direction != side )
+        {
+            player->offset = (player->error > 0) ? (int) (xorshift() % (2 * player->error + 1)) - player->error : 0;
+            player->direction = side;
+        }
+        target = g->ballY0 + player->offset;
+    }
+    else
+    {
+        player->direction = 0;
+        target = (TOP + BOTTOM) / 2;
+    }
+
+    // inverse of the paddle scaling in game(): target = (reading / 5) + 5
+    reading = ((target - 5) * 5) + 2;
+    if ( reading < 0 ) reading = 0;
+    if ( reading > 255 ) reading = 255;
+
+    return (uint8_t) reading;
+}
+
+/* ----------------------------------------------------------------------------
+ * simadc()
+ *
+ *  stub ADCH register: ADC0 is the right paddle, ADC1 the left paddle
+ *
+ */
+uint8_t simadc(void)
+{
+    return ( ADMUX & (1 << MUX0) ) ? adcLeft : adcRight;
+}
+
+/* ----------------------------------------------------------------------------
+ * xorshift()
+ *
+ *  per thread pseudo random number generator
+ *
+ */
+uint32_t xorshift(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+
+    return randomState;
+}
+
+/* ----------------------------------------------------------------------------
+ * histogram()
+ *
+ *  print a histogram with percentage bars, bins are 'width' units wide
+ *
+ */
+void histogram(const char* title, const uint64_t* bins, int count, int width)
+{
+    uint64_t    total = 0;
+    int         i;
+    int         bar;
+
+    for (i = 0; i < count; i++)
+        total += bins[i];
+
+    printf("%s\n", title);
+    for (i = 0; i < count; i++)
+    {
+        if ( total == 0 )
+            break;
+        bar = (int) ((bins[i] * 50) / total);
+        if ( width == 1 )
+            printf("  %3d%s ", i, (i == count - 1 && count == RALLYBINS) ? "+" : " ");
+        else
+            printf("  %2d-%-2d ", i * width, (i + 1) * width - 1);
+        printf("%6.2f%% %.*s\n", (100.0 * bins[i]) / total, bar, "##################################################");
+    }
+    printf("\n");
+}
@@ -0,0 +1,146 @@
+/* videotiming.h
+ *
+ * video timing profiles
+ * all Timer1 and UART counts are derived at compile time from the system clock
+ * and the selected video standard, and checked against the scan line time.
+ *
+ * build options:
+ *  -DSYSTEMCLK=<Hz>    8000000 (default), 16000000 or 20000000
+ *  -DCRYSTAL           8MHz from an external crystal instead of the internal RC oscillator
+ *                      (implied for any other clock, the internal RC runs at 8MHz)
+ *  -DVIDEOPAL          PAL 312 line field instead of NTSC 262 line field
+ *  -DPIXELBAUD=<bps>   UART pixel rate, 2000000 (default) or 4000000 with a 16MHz crystal
+ *  -DPIXELBYTES=<n>    bytes in scan line, pixel-resolution = PIXELBYTES x 8
+ *
+ */
+
+#ifndef __VIDEOTIMING_H__
+#define __VIDEOTIMING_H__
+
+/* ----------------------------------------------------------------------------
+ * system clock
+ */
+#ifndef SYSTEMCLK
+#define     SYSTEMCLK       8000000UL       // system clock frequency in Hz
+#endif
+
+#if ( SYSTEMCLK != 8000000UL ) && !defined(CRYSTAL)
+#define     CRYSTAL                         // only 8MHz is available from the internal RC oscillator
+#endif
+
+#define     CYCLES(ns)      (((SYSTEMCLK / 1000UL) * (ns)) / 1000000UL)   // CPU cycles in 'ns' nano-seconds
+
+/* ----------------------------------------------------------------------------
+ * video standard scan line structure
+ */
+#ifdef VIDEOPAL
+#define     LINEPERIODNS    64000UL         // horizontal line time 64uSec
+#define     VISIBLELINES    288             // scan lines 0-287 available for picture
+#define     SHOWNLINES      230             // about the number of picture lines a TV shows, the rest is overscan
+#define     VSYNCLINE       298             // line to produce v-sync pulse
+#define     PRERENDER       301             // blank lines before restarting render
+#define     LINESINFIELD    312             // total lines in field
+#else
+#define     LINEPERIODNS    63556UL         // horizontal line time 63.5uSec
+#define     VISIBLELINES    240             // scan lines 0-239 available for picture
+#define     SHOWNLINES      188             // about the number of picture lines a TV shows, the rest is overscan
+#define     VSYNCLINE       245             // line to produce v-sync pulse
+#define     PRERENDER       248             // blank lines before restarting render
+#define     LINESINFIELD    262             // total lines in field
+#endif
+
+#define     HSYNCNS         4700UL          // horizontal sync pulse width 4.7uSec
+#define     BACKPORCHNS     4700UL          // back-porch time width 4.7uSec
+#define     VSYNCGAPNS      7500UL          // 'hi' gap at end of a v-sync line
+
+/* ----------------------------------------------------------------------------
+ * Timer1 counts (Fclk/1, fast PWM mode 14, TOP in ICR1)
+ */
+#if ( SYSTEMCLK == 8000000UL ) && !defined(CRYSTAL) && !defined(VIDEOPAL)
+// counts hand-tuned for the internal 8MHz RC oscillator and NTSC
+// all counts are reduced to compensate for the oscillator error
+#define     LINERATE        495             // horizontal line rate 63.5uSec
+#define     HSYNC           35              // horizontal sync pulse width 4.7uSec
+#define     VSYNC           435             // vsync pulse width
+#else
+#define     LINERATE        (CYCLES(LINEPERIODNS) - 1)
+#define     HSYNC           CYCLES(HSYNCNS)
+#define     VSYNC           (LINERATE - CYCLES(VSYNCGAPNS))
+#endif
+
+#define     LINECYCLES      (LINERATE + 1)  // CPU cycles in one scan line
+#define     BACKPORCH       CYCLES(BACKPORCHNS)
+#define     PIXELSTART      (HSYNC + BACKPORCH) // Timer1 count of first pixel, end of back-porch
+
+/* ----------------------------------------------------------------------------
+ * pixel output through UART in SPI mode, baud = Fclk / (2 x (UBRR0 + 1))
+ */
+#ifndef PIXELBAUD
+#define     PIXELBAUD       2000000UL       // pixel rate in bits per second
+#endif
+#ifndef PIXELBYTES
+#define     PIXELBYTES      11              // bytes in scan line, pixel-resolution = PIXELBYTES x 8
+#endif
+
+#define     PIXELUBRR       ((SYSTEMCLK / (2 * PIXELBAUD)) - 1)
+#define     PIXELBITCYCLES  (SYSTEMCLK / PIXELBAUD)                 // CPU cycles per pixel
+#define     PIXELCYCLES     (PIXELBYTES * 8 * PIXELBITCYCLES)       // CPU cycles to shift out a scan line
+
+/* ----------------------------------------------------------------------------
+ * per scan line costs
+ * the scan line ISR, the dispatch loop in main() and renderer() are in assembly,
+ * their costs are counted from the instructions with the cycle counts of the AVR
+ * instruction set manual, worst case for polls. the phase ISR and game() are compiled C,
+ * their costs are an estimate and a measurement, and are checked with x2 margin.
+ */
+#define     ISRCYCLES       59              // line start to renderer() Timer1 poll: 29 cycle ISR from sleep, dispatch 7, row set-up 23
+#define     PHASECYCLES     150             // line start to end of a phase change: 29 cycle ISR, phase ISR prologue, table reads (estimate)
+#define     RENDERSTART     (19 + PIXELBITCYCLES)   // PIXELSTART to first pixel: 12 cycle Timer1 poll exit, first byte and TXEN0 writes, one bit to start
+#define     PIXELLOOP       25              // renderer() from one pixel byte to the next: 18 cycle loop, 7 cycle UDRE0 poll exit
+#define     ROWADVANCE      23              // renderer() during the last data byte: 7 cycle UDRE0 poll exit, stuffing byte write 2, row advance 14
+#define     RENDERTAIL      24              // renderer() after the last pixel: 7 cycle UDRE0 poll exit, UART shut-down 10, ret 4, back to sleep 3
+#define     LINEMARGIN      16              // spare cycles required on a rendered line, for the interrupt and UART start-up timing
+#define     GAMECYCLES      2400            // game() worst case, measured 150uSec @ 8MHz on a scope, with x2 margin
+
+#ifdef PERFMON
+#define     PERFRENDER      8               // performance monitor in renderer(): Timer1 latch at the end of every rendered line
+#else
+#define     PERFRENDER      0
+#endif
+
+/* ----------------------------------------------------------------------------
+ * profile checks
+ */
+#if ( LINERATE > 0xffff )
+#error "scan line does not fit Timer1"
+#endif
+
+#if ( VSYNC <= HSYNC ) || ( VSYNC >= LINERATE )
+#error "v-sync pulse width out of range"
+#endif
+
+#if ( (SYSTEMCLK % (2 * PIXELBAUD)) != 0 ) || ( PIXELBAUD > (SYSTEMCLK / 2) )
+#error "PIXELBAUD cannot be generated from SYSTEMCLK"
+#endif
+
+#if ( ISRCYCLES > PIXELSTART ) || ( (PIXELSTART + RENDERSTART + PIXELCYCLES + RENDERTAIL + PERFRENDER + LINEMARGIN) > LINECYCLES )
+#error "pixel bytes and ISR do not fit in a scan line"
+#endif
+
+// every pixel byte must be written before the previous one has shifted out,
+// the row advance runs while the last data byte shifts out
+#if ( PIXELLOOP > (8 * PIXELBITCYCLES) )
+#error "renderer() pixel byte loop is slower than the pixel rate"
+#endif
+
+#if ( ROWADVANCE > (8 * PIXELBITCYCLES) )
+#error "renderer() row advance does not fit in one pixel byte"
+#endif
+
+// phase changes only happen on blank lines, the render phase is entered one line early,
+// and the phase ISR must be done before the next line's interrupt
+#if ( (2 * PHASECYCLES) > LINECYCLES )
+#error "phase ISR does not fit in a scan line"
+#endif
+
+#endif /* __VIDEOTIMING_H__ */
@@ -10,21 +10,24 @@
 #include    <stdint.h>
 #include    <stdlib.h>
 
+#include    <avr/pgmspace.h>
+
 #include    "videoutil.h"
 
 /* ----------------------------------------------------------------------------
  * global variables
+ * drawing state is kept in the video_t and region_t structures passed
+ * to the functions, only the drawing tables are global
  */
-uint16_t    horisontalPixels = 0;
-uint16_t    verticalPixels   = 0;
-uint8_t     horizontalBytes  = 0;
-uint16_t    bufferSize       = 0;
-uint8_t     *videoBuffer     = 0;
-uint8_t     initialized      = 0;
-
 uint8_t     bitFlip[8] = {0x80, 0x40, 0x20, 0x10,
                           0x08, 0x04, 0x02, 0x01};
 
+// sprite row multipliers for blit(), (row x shiftMul[x & 7]) gives
+// the row shifted right by (x & 7) in the high byte and the bits that spill
+// into the next byte in the low byte, using the hardware multiplier instead of a shift loop
+const uint16_t shiftMul[8] PROGMEM = {0x0100, 0x0080, 0x0040, 0x0020,
+                                      0x0010, 0x0008, 0x0004, 0x0002};
+
 // definitions and data for digit fonts
 #define     FONTBYTES   7   // number of bitmap data bytes per digit font
 #define     FONTWIDTH   6   // 5 pixels plus 1 pixel space between characters
@@ -45,38 +48,55 @@ uint8_t     font[70]   = {0x70, 0x88, 0x88, 0x88, 0x88, 0x88, 0x70,     // '0'
 
  void box(uint16_t, uint16_t, uint16_t, uint16_t);        // draw a box between points (X1,Y1)-(X2,Y2)
  void write(uint16_t, uint16_t, const char*);             // write text string at coordinate (X,Y)
- void clearbox(uint16_t, uint16_t, uint16_t, uint16_t);   // clear a rectangle (X1,Y1)-(X2,Y2)
 
  */
 
 /* ----------------------------------------------------------------------------
  * videoinit()
  *
- *  initialize video area to size (Hor,Ver) pixels
+ *  initialize video area 'v' to size (Hor,Ver) pixels in 'buffer'
  *
  */
-void videoinit(uint8_t* buffer, uint16_t hpixels, uint16_t vpixels)
+void videoinit(video_t* v, uint8_t* buffer, uint16_t hpixels, uint16_t vpixels)
 {
-    videoBuffer      = buffer;      // initialize globals
-    horisontalPixels = hpixels-1;
-    verticalPixels   = vpixels-1;
-    horizontalBytes  = hpixels / 8;
-    bufferSize       = (hpixels / 8 ) * vpixels;
+    v->videoBuffer      = buffer;   // initialize video state
+    v->horisontalPixels = hpixels-1;
+    v->verticalPixels   = vpixels-1;
+    v->horizontalBytes  = hpixels / 8;
+    v->bufferSize       = (hpixels / 8 ) * vpixels;
+    v->imageData        = 0;        // no image being decoded
+    v->imageRow         = 0;
+    v->imageRowsLeft    = 0;
+    v->background       = 0;        // no background layer
+
+    v->initialized      = 1;        // every function must check this flag before rendering!
+}
 
-    initialized      = 1;           // every function must check this flag before rendering!
+/* ----------------------------------------------------------------------------
+ * videobackground()
+ *
+ *  set the function that returns the background layer byte at a row and byte column,
+ *  for a layer that the renderer adds to the video buffer on the way out (such as the pong
+ *  board walls and net). ppeek() and blit() overlap tests then see the background pixels too.
+ *  0 for no background layer
+ *
+ */
+void videobackground(video_t* v, uint8_t (*background)(uint16_t, uint8_t))
+{
+    v->background = background;
 }
 
 /* ----------------------------------------------------------------------------
  * videoinit()
  */
-void clear(uint8_t pattern)
+void clear(video_t* v, uint8_t pattern)
 {
     uint16_t    i;
 
-    if ( !initialized ) return;
+    if ( !v->initialized ) return;
 
-    for (i = 0; i < bufferSize; i++)
-        videoBuffer[i] = pattern;
+    for (i = 0; i < v->bufferSize; i++)
+        v->videoBuffer[i] = pattern;
 }
 
 /* ----------------------------------------------------------------------------
@@ -86,20 +106,20 @@ void clear(uint8_t pattern)
  *  set pixel color to foreground 'white'
  *
  */
-void pset(uint16_t x, uint16_t y)
+void pset(video_t* v, uint16_t x, uint16_t y)
 {
     uint16_t    index;
     uint8_t     byteLocation;
     uint8_t     pattern;
 
-    if ( !initialized ) return;
+    if ( !v->initialized ) return;
 
-    if ( x > horisontalPixels || y > verticalPixels ) return;
+    if ( x > v->horisontalPixels || y > v->verticalPixels ) return;
 
     byteLocation = x / 8;
-    index = (y * horizontalBytes) + byteLocation;  // byte index of the pixel
+    index = (y * v->horizontalBytes) + byteLocation; // byte index of the pixel
     pattern = bitFlip[(x - (byteLocation * 8))];   // bit index of the pixel
-    videoBuffer[index] |= pattern;                 // set the bit
+    v->videoBuffer[index] |= pattern;              // set the bit
 }
 
 /* ----------------------------------------------------------------------------
@@ -109,20 +129,20 @@ void pset(uint16_t x, uint16_t y)
  *  set pixel color to background 'black'
  *
  */
-void preset(uint16_t x, uint16_t y)
+void preset(video_t* v, uint16_t x, uint16_t y)
 {
     uint16_t    index;
     uint8_t     byteLocation;
     uint8_t     pattern;
 
-    if ( !initialized ) return;
+    if ( !v->initialized ) return;
 
-    if ( x > horisontalPixels || y > verticalPixels ) return;
+    if ( x > v->horisontalPixels || y > v->verticalPixels ) return;
 
     byteLocation = x / 8;
-    index = (y * horizontalBytes) + byteLocation;  // byte index of the pixel
+    index = (y * v->horizontalBytes) + byteLocation; // byte index of the pixel
     pattern = bitFlip[(x - (byteLocation * 8))];   // bit index of the pixel
-    videoBuffer[index] &= ~(pattern);              // set the bit
+    v->videoBuffer[index] &= ~(pattern);           // set the bit
 }
 
 /* ----------------------------------------------------------------------------
@@ -132,20 +152,46 @@ void preset(uint16_t x, uint16_t y)
  *  reverse (XOR) pixel color to background 'black' or foreground 'white'
  *
  */
-void pflip(uint16_t x, uint16_t y)
+void pflip(video_t* v, uint16_t x, uint16_t y)
+{
+    uint16_t    index;
+    uint8_t     byteLocation;
+    uint8_t     pattern;
+
+    if ( !v->initialized ) return;
+
+    if ( x > v->horisontalPixels || y > v->verticalPixels ) return;
+
+    byteLocation = x / 8;
+    index = (y * v->horizontalBytes) + byteLocation; // byte index of the pixel
+    pattern = bitFlip[(x - (byteLocation * 8))];   // bit index of the pixel
+    v->videoBuffer[index] ^= pattern;              // XOR the bit
+}
+
+/* ----------------------------------------------------------------------------
+ * ppeek()
+ *
+ *  read a pixel at screen coordinate (X,Y)
+ *  return 1 if pixel is foreground 'white', 0 if background 'black' or outside the screen
+ *  a background layer set with videobackground() is seen as foreground
+ *
+ */
+uint8_t ppeek(video_t* v, uint16_t x, uint16_t y)
 {
     uint16_t    index;
     uint8_t     byteLocation;
     uint8_t     pattern;
 
-    if ( !initialized ) return;
+    if ( !v->initialized ) return 0;
 
-    if ( x > horisontalPixels || y > verticalPixels ) return;
+    if ( x > v->horisontalPixels || y > v->verticalPixels ) return 0;
 
     byteLocation = x / 8;
-    index = (y * horizontalBytes) + byteLocation;  // byte index of the pixel
+    index = (y * v->horizontalBytes) + byteLocation; // byte index of the pixel
     pattern = bitFlip[(x - (byteLocation * 8))];   // bit index of the pixel
-    videoBuffer[index] ^= pattern;                 // XOR the bit
+    if ( v->background && (v->background(y, byteLocation) & pattern) )
+        return 1;
+    return ( (v->videoBuffer[index] & pattern) ? 1 : 0 );
 }
 
 /* ----------------------------------------------------------------------------
@@ -157,13 +203,13 @@ void pflip(uint16_t x, uint16_t y)
  *  function will draw clipped lines.
  *
  */
-void line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+void line(video_t* v, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 {
     int dx, sx;
     int dy, sy;
     int err, e2;
 
-    if ( !initialized ) return;
+    if ( !v->initialized ) return;
 
     dx = abs(x1-x0);
     sx = x0<x1 ? 1 : -1;
@@ -172,7 +218,7 @@ void line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
     err = (dx>dy ? dx : -dy)/2;
     for(;;)
     {
-        pset(x0,y0);
+        pset(v, x0, y0);
         if (x0==x1 && y0==y1) break;
         e2 = err;
         if (e2 >-dx) { err -= dy; x0 += sx; }
@@ -186,23 +232,331 @@ void line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
  *  write a character starting at top left coordinate (X,Y) of the text box
  *
  */
-void writechar(uint16_t x, uint16_t y, const char text)
+void writechar(video_t* v, uint16_t x, uint16_t y, const char text)
 {
     uint16_t    indexVid;
     uint16_t    indexFont;
     uint8_t     i;
 
-    if ( !initialized ) return;
+    if ( !v->initialized ) return;
 
     if ( (uint8_t) text < '0' || (uint8_t) text > '9' ) return;
 
-    indexVid = (x / 8) + horizontalBytes * y;
+    indexVid = (x / 8) + v->horizontalBytes * y;
     indexFont = ((uint8_t) text - 48) * FONTBYTES;
 
-    for ( i = 0; i < FONTBYTES; i++, indexVid += horizontalBytes, indexFont++)
+    for ( i = 0; i < FONTBYTES; i++, indexVid += v->horizontalBytes, indexFont++)
+    {
+        v->videoBuffer[indexVid] = font[indexFont];
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * clearbox()
+ *
+ *  clear a rectangle (X1,Y1)-(X2,Y2) to background 'black'
+ *  rectangle is clipped to the screen, and cleared a byte at a time
+ *  with partial byte masks on the left and right edges
+ *
+ */
+void clearbox(video_t* v, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    uint16_t    index;
+    uint16_t    temp;
+    uint8_t     firstByte, lastByte;
+    uint8_t     leftMask, rightMask;
+    uint8_t     i;
+
+    if ( !v->initialized ) return;
+
+    if ( x1 > x2 ) { temp = x1; x1 = x2; x2 = temp; }
+    if ( y1 > y2 ) { temp = y1; y1 = y2; y2 = temp; }
+
+    if ( x1 > v->horisontalPixels || y1 > v->verticalPixels ) return;
+    if ( x2 > v->horisontalPixels ) x2 = v->horisontalPixels;
+    if ( y2 > v->verticalPixels ) y2 = v->verticalPixels;
+
+    firstByte = x1 / 8;
+    lastByte  = x2 / 8;
+    leftMask  = 0xff >> (x1 & 7);                   // pixels from X1 to end of first byte
+    rightMask = (uint8_t) (0xff << (7 - (x2 & 7))); // pixels from start of last byte to X2
+    if ( firstByte == lastByte )
+        leftMask &= rightMask;
+
+    for ( ; y1 <= y2; y1++)
+    {
+        index = (y1 * v->horizontalBytes) + firstByte;
+        v->videoBuffer[index] &= ~(leftMask);
+        if ( firstByte == lastByte )
+            continue;
+        for (i = firstByte + 1; i < lastByte; i++)
+            v->videoBuffer[++index] = 0;
+        v->videoBuffer[++index] &= ~(rightMask);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * blit()
+ *
+ *  draw a sprite stored in flash with its top left corner at screen coordinate (X,Y)
+ *  sprite format: { height, row[0], row[1] .. row[height-1] }
+ *  sprites are up to 8 pixels wide, one byte per row, MSB is the left most pixel.
+ *  each sprite row touches at most two video buffer bytes, so a 4x4 ball
+ *  takes 8 byte writes and an 8-row paddle 8 or 16 byte writes.
+ *  operation is one of BLITOR, BLITANDNOT, BLITXOR or BLITTEST.
+ *  sprite is clipped at the screen edges, coordinates can be negative.
+ *
+ *  returns non-zero if any sprite pixel overlapped a foreground pixel
+ *  before the operation. with BLITTEST nothing is drawn, so moving objects
+ *  can test their next position against everything already drawn (paddles, bricks)
+ *  with one byte AND per sprite row byte, independent of the number of obstacles.
+ *  pixels clipped outside the screen never overlap, pixels of a background layer
+ *  set with videobackground() (the pong board walls and net) do.
+ *
+ */
+uint8_t blit(video_t* v, const uint8_t* sprite, int16_t x, int16_t y, uint8_t op)
+{
+    uint8_t     *rowPtr;
+    int16_t     byteCol;
+    uint16_t    multiplier;
+    uint16_t    pattern;
+    uint8_t     height;
+    uint8_t     row;
+    uint16_t    screenRow;
+    uint8_t     leftIn, rightIn;
+    uint8_t     leftByte, rightByte;
+    uint8_t     overlap;
+
+    if ( !v->initialized ) return 0;
+
+    height = pgm_read_byte(sprite);
+
+    // sprite completely outside the screen
+    if ( x > (int16_t) v->horisontalPixels || y > (int16_t) v->verticalPixels ) return 0;
+    if ( (x + 8) <= 0 || (y + height) <= 0 ) return 0;
+
+    // vertical clipping
+    row = 0;
+    if ( y < 0 )
+    {
+        row = -y;
+        y   = 0;
+    }
+    if ( (y + height - row) > (int16_t) (v->verticalPixels + 1) )
+        height = v->verticalPixels + 1 - y + row;
+
+    // horizontal clipping, a sprite row covers byte column 'byteCol' and
+    // byte column 'byteCol+1' if it is not byte aligned, rowPtr points to 'byteCol+1'
+    // so that it stays inside the buffer when the sprite is clipped on the left
+    byteCol    = x >> 3;
+    multiplier = pgm_read_word(&shiftMul[x & 7]);
+    leftIn     = ( byteCol >= 0 );
+    rightIn    = ( (x & 7) != 0 && (byteCol + 1) < v->horizontalBytes );
+
+    rowPtr    = v->videoBuffer + (y * v->horizontalBytes) + (byteCol + 1);
+    screenRow = y;
+    overlap   = 0;
+
+    for ( ; row < height; row++, screenRow++, rowPtr += v->horizontalBytes)
+    {
+        pattern   = pgm_read_byte(sprite + 1 + row) * multiplier;
+        leftByte  = leftIn  ? (uint8_t) (pattern >> 8) : 0;
+        rightByte = rightIn ? (uint8_t) pattern : 0;
+
+        if ( leftByte )  overlap |= rowPtr[-1] & leftByte;
+        if ( rightByte ) overlap |= rowPtr[0] & rightByte;
+
+        if ( v->background )
+        {
+            if ( leftByte )  overlap |= v->background(screenRow, byteCol) & leftByte;
+            if ( rightByte ) overlap |= v->background(screenRow, (byteCol + 1)) & rightByte;
+        }
+
+        switch ( op )
+        {
+        case BLITOR:
+            if ( leftByte )  rowPtr[-1] |= leftByte;
+            if ( rightByte ) rowPtr[0] |= rightByte;
+            break;
+
+        case BLITANDNOT:
+            if ( leftByte )  rowPtr[-1] &= ~leftByte;
+            if ( rightByte ) rowPtr[0] &= ~rightByte;
+            break;
+
+        case BLITXOR:
+            if ( leftByte )  rowPtr[-1] ^= leftByte;
+            if ( rightByte ) rowPtr[0] ^= rightByte;
+            break;
+
+        case BLITTEST:
+            break;
+        }
+    }
+
+    return overlap;
+}
+
+/* ----------------------------------------------------------------------------
+ * imagestart()
+ *
+ *  start decoding a compressed image stored in flash into the video buffer,
+ *  with the image's top row at screen row Y.
+ *  image format: { rows, bytes per row, row codes .. }
+ *  every row is coded independently of the next with these codes:
+ *    0x00-0x7f  (n+1) literal bytes follow
+ *    0x80-0xbf  the next byte is repeated (n+1) times
+ *    0xc0-0xff  (n+1) bytes are copied from the row above (vertical delta)
+ *  images are made with the host tool tools/imgenc.c
+ *  image width must match the video buffer width, image rows below the screen are dropped
+ *
+ */
+void imagestart(video_t* v, const uint8_t* image, uint16_t y)
+{
+    uint8_t     rows;
+
+    v->imageRowsLeft = 0;
+
+    if ( !v->initialized ) return;
+
+    if ( pgm_read_byte(image + 1) != v->horizontalBytes || y > v->verticalPixels ) return;
+
+    rows = pgm_read_byte(image);
+    if ( (y + rows) > (v->verticalPixels + 1) )
+        rows = v->verticalPixels + 1 - y;
+
+    v->imageData     = image + 2;
+    v->imageRow      = y;
+    v->imageRowsLeft = rows;
+}
+
+/* ----------------------------------------------------------------------------
+ * imagestep()
+ *
+ *  decode up to 'rows' rows of the image started with imagestart()
+ *  call from game() on every frame with a row count that fits the v-blank budget,
+ *  a row takes at most about 200 cycles.
+ *  return 1 when the image is complete (or no image was started), 0 otherwise
+ *
+ */
+uint8_t imagestep(video_t* v, uint8_t rows)
+{
+    uint8_t     *dest;
+    uint8_t     code;
+    uint8_t     count;
+    uint8_t     value;
+    uint8_t     col;
+
+    for ( ; rows > 0 && v->imageRowsLeft > 0; rows--, v->imageRowsLeft--, v->imageRow++)
     {
-        videoBuffer[indexVid] = font[indexFont];
+        if ( v->imageRow > v->verticalPixels )
+        {
+            v->imageRowsLeft = 0;           // buffer changed since imagestart(), do not run past it
+            break;
+        }
+
+        dest = v->videoBuffer + (v->imageRow * v->horizontalBytes);
+
+        for (col = 0; col < v->horizontalBytes; )
+        {
+            code  = pgm_read_byte(v->imageData++);
+            count = (code & ((code & IMGREPEAT) ? 0x3f : 0x7f)) + 1;
+            if ( count > (v->horizontalBytes - col) )
+                count = v->horizontalBytes - col; // bad image, do not run past the row
+
+            switch ( code & IMGCOPY )
+            {
+            case IMGREPEAT:
+                value = pgm_read_byte(v->imageData++);
+                for ( ; count > 0; count--, col++)
+                    dest[col] = value;
+                break;
+
+            case IMGCOPY:
+                for ( ; count > 0; count--, col++)
+                    dest[col] = ( v->imageRow > 0 ) ? dest[col - v->horizontalBytes] : 0;
+                break;
+
+            default:
+                for ( ; count > 0; count--, col++)
+                    dest[col] = pgm_read_byte(v->imageData++);
+            }
+        }
     }
+
+    return ( v->imageRowsLeft == 0 );
+}
+
+/* ----------------------------------------------------------------------------
+ * regioninit()
+ *
+ *  set up a double buffered band of 'rows' rows starting at row 'top' of video buffer 'v'
+ *  (for example the score band), 'back' must hold rows x bytes-per-row bytes.
+ *  the band's rows in the video buffer are the first front buffer.
+ *  renderer() reads the band's rows from the front buffer, and the front and
+ *  back buffers are swapped by pointer in the v-blank after regioncommit(), without copying.
+ *  after regioninit() the band belongs to the region, do not draw into it through 'v',
+ *  draw only through the video_t returned by regionclaim().
+ *
+ */
+void regioninit(region_t* r, video_t* v, uint8_t* back, uint16_t top, uint16_t rows)
+{
+    if ( !v->initialized ) return;
+
+    r->rows    = 0;                 // renderer() ignores the region while it is set up
+    r->claimed = 0;
+
+    if ( top > v->verticalPixels || rows == 0 ) return;
+    if ( (top + rows) > (v->verticalPixels + 1) )
+        rows = v->verticalPixels + 1 - top;
+
+    // back buffer drawing state, same width as the video buffer and 'rows' high
+    videoinit(&r->target, back, (v->horizontalBytes * 8), rows);
+
+    r->commit = 0;
+    r->front  = v->videoBuffer + (top * v->horizontalBytes);
+    r->back   = back;
+    r->top    = top;
+    r->rows   = rows;
+}
+
+/* ----------------------------------------------------------------------------
+ * regionclaim()
+ *
+ *  start drawing into the region's back buffer,
+ *  return the back buffer's video_t to pass to the drawing functions, Y coordinates
+ *  are relative to the region's top row and clipped to the region.
+ *  drawing through the video buffer's own video_t is not affected, so game() can
+ *  keep drawing the rest of the screen on every field while the region is drawn.
+ *  the back buffer holds the content from before the last commit,
+ *  so the region should be redrawn completely (start with clear(0)).
+ *  drawing can take as many frames as needed until regioncommit().
+ *  return 0 if no region is set up or the last commit has not been flipped yet
+ *
+ */
+video_t* regionclaim(region_t* r)
+{
+    if ( r->rows == 0 || r->commit ) return 0;
+
+    r->target.videoBuffer = r->back;    // buffers are swapped in the v-blank after every commit
+    r->claimed = 1;
+
+    return &r->target;
+}
+
+/* ----------------------------------------------------------------------------
+ * regioncommit()
+ *
+ *  end drawing into the region's back buffer,
+ *  the back buffer is shown from the next field
+ *
+ */
+void regioncommit(region_t* r)
+{
+    if ( !r->claimed ) return;
+
+    r->claimed = 0;
+    r->commit  = 1;
 }
 
 /* ----------------------------------------------------------------------------
@@ -211,9 +565,9 @@ void writechar(uint16_t x, uint16_t y, const char text)
  *  get X resolution / max pixel count
  *
  */
-uint16_t getXres(void)
+uint16_t getXres(video_t* v)
 {
-    return horisontalPixels;
+    return v->horisontalPixels;
 }
 
 /* ----------------------------------------------------------------------------
@@ -222,7 +576,7 @@ uint16_t getXres(void)
  *  get Y resolution / max pixel count
  *
  */
-uint16_t getYres(void)
+uint16_t getYres(video_t* v)
 {
-    return verticalPixels;
+    return v->verticalPixels;
 }
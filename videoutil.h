@@ -8,19 +8,70 @@
 #ifndef __VIDEOUTIL_H__
 #define __VIDEOUTIL_H__
 
+/* ----------------------------------------------------------------------------
+ *  definitions
+ */
+#define     BLITOR      0                                   // blit() operations: set sprite pixels
+#define     BLITANDNOT  1                                   // clear sprite pixels
+#define     BLITXOR     2                                   // flip sprite pixels
+#define     BLITTEST    3                                   // only test sprite pixels for overlap, no drawing
+
+#define     IMGLITERAL  0x00                                // image stream codes: 0x00-0x7f (n+1) literal bytes follow
+#define     IMGREPEAT   0x80                                // 0x80-0xbf next byte repeated (n+1) times
+#define     IMGCOPY     0xc0                                // 0xc0-0xff copy (n+1) bytes from the row above
+
+/* ----------------------------------------------------------------------------
+ *  types
+ *
+ *  all drawing state is in a video_t passed to every drawing function,
+ *  so independent video buffers (for example one per simulated game) can be drawn at the same time
+ */
+typedef struct
+{
+    uint8_t     *videoBuffer;                               // video buffer, one bit per pixel, MSB is the left most pixel
+    uint16_t    horisontalPixels;                           // last pixel column
+    uint16_t    verticalPixels;                             // last pixel row
+    uint8_t     horizontalBytes;                            // bytes per row
+    uint16_t    bufferSize;                                 // bytes in video buffer
+    uint8_t     initialized;                                // every function must check this flag before rendering!
+    uint8_t     (*background)(uint16_t, uint8_t);           // background layer byte at row Y and byte column, 0 for none
+    const uint8_t *imageData;                               // image decoder state, kept between imagestep() calls
+    uint16_t    imageRow;
+    uint8_t     imageRowsLeft;
+} video_t;
+
+typedef struct
+{
+    uint8_t     *front;                                     // region rows read by renderer()
+    uint8_t     *back;                                      // region rows drawn between regionclaim() and regioncommit()
+    uint8_t     top;                                        // first row of the region in the video buffer
+    uint8_t     rows;                                       // rows in region, 0 for no region
+    volatile uint8_t commit;                                // back buffer complete, flip in next v-blank
+    uint8_t     claimed;                                    // back buffer is being drawn
+    video_t     target;                                     // drawing state of the back buffer, returned by regionclaim()
+} region_t;
+
 /* ----------------------------------------------------------------------------
  *  function prototypes
  */
-void    videoinit(uint8_t*, uint16_t, uint16_t);            // initialize video area to size (Hor,Ver) pixels
-void    clear(uint8_t);                                     // clear the video RAM to an 8-bit pattern
-void    pset(uint16_t, uint16_t);                           // set a pixel at screen coordinate (X,Y)
-void    preset(uint16_t, uint16_t);                         // clear a pixel at screen coordinate (X,Y)
-void    pflip(uint16_t x, uint16_t y);                      // flip (XOR) a pixel at screen coordinate (X,Y)
-void    line(uint16_t, uint16_t, uint16_t, uint16_t);       // draw a line between points (X1,Y1)-(X2,Y2)
+void    videoinit(video_t*, uint8_t*, uint16_t, uint16_t);  // initialize video area to size (Hor,Ver) pixels
+void    videobackground(video_t*, uint8_t (*)(uint16_t, uint8_t)); // set the background layer seen by ppeek() and blit()
+void    clear(video_t*, uint8_t);                           // clear the video RAM to an 8-bit pattern
+void    pset(video_t*, uint16_t, uint16_t);                 // set a pixel at screen coordinate (X,Y)
+void    preset(video_t*, uint16_t, uint16_t);               // clear a pixel at screen coordinate (X,Y)
+void    pflip(video_t*, uint16_t x, uint16_t y);            // flip (XOR) a pixel at screen coordinate (X,Y)
+uint8_t ppeek(video_t*, uint16_t, uint16_t);                // read a pixel at screen coordinate (X,Y)
+void    line(video_t*, uint16_t, uint16_t, uint16_t, uint16_t); // draw a line between points (X1,Y1)-(X2,Y2)
 //void    box(uint16_t, uint16_t, uint16_t, uint16_t);        // draw a box between points (X1,Y1)-(X2,Y2)
-void    writechar(uint16_t, uint16_t, const char);          // write character at coordinate (X,Y)
-//void    clearbox(uint16_t, uint16_t, uint16_t, uint16_t);   // clear a rectangle (X1,Y1)-(X2,Y2)
-uint16_t getXres(void);                                     // get X resolution / max pixel count
-uint16_t getYres(void);                                     // get Y resolution / max pixel count
+void    writechar(video_t*, uint16_t, uint16_t, const char);    // write character at coordinate (X,Y)
+void    clearbox(video_t*, uint16_t, uint16_t, uint16_t, uint16_t); // clear a rectangle (X1,Y1)-(X2,Y2)
+uint8_t blit(video_t*, const uint8_t*, int16_t, int16_t, uint8_t); // draw/test a flash sprite at (X,Y), return overlap with set pixels
+void    imagestart(video_t*, const uint8_t*, uint16_t);     // start decoding a flash image into video RAM at row Y
+uint8_t imagestep(video_t*, uint8_t);                       // decode up to N image rows, return 1 when image is complete
+void    regioninit(region_t*, video_t*, uint8_t*, uint16_t, uint16_t); // set up a double buffered band of rows (back buffer, top row, rows)
+video_t* regionclaim(region_t*);                            // get the region's back buffer to draw into, 0 if last commit is not flipped yet
+void    regioncommit(region_t*);                            // end drawing, back buffer is shown from next field
+uint16_t getXres(video_t*);                                 // get X resolution / max pixel count
+uint16_t getYres(video_t*);                                 // get Y resolution / max pixel count
 
 #endif /* __VIDEOUTIL_H__ */